@@ -0,0 +1,252 @@
+#include "Compositor.h"
+
+#include <algorithm>
+#include <cstring>
+
+// SSE2 is a part of x64, the 32-bit builds get it with /arch:SSE2 (the default of the compiler)
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DIP_COMPOSITOR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+	// the pixels blended at once through the stack buffers
+	const int CHUNK = 64;
+
+	// the division by 255 with rounding, exact for the products of two bytes
+	inline unsigned char divide255(int value)
+	{
+		value += 128;
+		// the premultiplied channels brighter than the alpha saturate
+		return static_cast<unsigned char>(std::min((value + (value >> 8)) >> 8, 255));
+	}
+
+	// the straight alpha is applied to the source, the premultiplied one has been applied already
+	void blendScalar(unsigned char *pixels, const unsigned char *backdrop, int count, bool premultiplied)
+	{
+		for (int x = 0; x < count; ++x) {
+			unsigned char *pixel = pixels + x * 4;
+			int alpha = pixel[3];
+			if (alpha == 255) {
+				continue;
+			}
+			int factor = premultiplied ? 255 : alpha;
+			for (int c = 0; c < 3; ++c) {
+				pixel[c] = divide255(pixel[c] * factor + backdrop[x * 4 + c] * (255 - alpha));
+			}
+			pixel[3] = 255;
+		}
+	}
+
+#ifdef DIP_COMPOSITOR_SSE2
+
+	// blends two BGRA pixels widened to 16 bits, the sums saturate as the scalar ones do
+	inline __m128i blendPair(__m128i source, __m128i backdrop, bool premultiplied)
+	{
+		const __m128i full = _mm_set1_epi16(255);
+		const __m128i half = _mm_set1_epi16(128);
+
+		__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, 0xFF), 0xFF);
+		__m128i factor = premultiplied ? full : alpha;
+
+		__m128i value = _mm_adds_epu16(_mm_mullo_epi16(source, factor), _mm_mullo_epi16(backdrop, _mm_sub_epi16(full, alpha)));
+		value = _mm_adds_epu16(value, half);
+		return _mm_srli_epi16(_mm_adds_epu16(value, _mm_srli_epi16(value, 8)), 8);
+	}
+
+	void blendSse2(unsigned char *pixels, const unsigned char *backdrop, int count, bool premultiplied)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+		int x = 0;
+		for (; x + 4 <= count; x += 4) {
+			__m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x * 4));
+
+			// the spans of the opaque pixels are left as they are
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(source, opaque), opaque)) == 0xFFFF) {
+				continue;
+			}
+
+			__m128i back = _mm_loadu_si128(reinterpret_cast<const __m128i *>(backdrop + x * 4));
+			__m128i low = blendPair(_mm_unpacklo_epi8(source, zero), _mm_unpacklo_epi8(back, zero), premultiplied);
+			__m128i high = blendPair(_mm_unpackhi_epi8(source, zero), _mm_unpackhi_epi8(back, zero), premultiplied);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + x * 4), _mm_or_si128(_mm_packus_epi16(low, high), opaque));
+		}
+
+		blendScalar(pixels + x * 4, backdrop + x * 4, count - x, premultiplied);
+	}
+
+#endif // DIP_COMPOSITOR_SSE2
+
+	bool isOpaqueScalar(const unsigned char *pixels, int count)
+	{
+		for (int x = 0; x < count; ++x) {
+			if (pixels[x * 4 + 3] != 255) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+#ifdef DIP_COMPOSITOR_SSE2
+
+	bool isOpaqueSse2(const unsigned char *pixels, int count)
+	{
+		const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+		// the alpha of 16 pixels is checked at once
+		int x = 0;
+		for (; x + 16 <= count; x += 16) {
+			const __m128i *block = reinterpret_cast<const __m128i *>(pixels + x * 4);
+			__m128i alpha = _mm_and_si128(_mm_and_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)), _mm_and_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(alpha, opaque), opaque)) != 0xFFFF) {
+				return false;
+			}
+		}
+
+		return isOpaqueScalar(pixels + x * 4, count - x);
+	}
+
+#endif // DIP_COMPOSITOR_SSE2
+
+	void blend(unsigned char *pixels, const unsigned char *backdrop, int count, bool premultiplied)
+	{
+#ifdef DIP_COMPOSITOR_SSE2
+		blendSse2(pixels, backdrop, count, premultiplied);
+#else
+		blendScalar(pixels, backdrop, count, premultiplied);
+#endif
+	}
+
+} // namespace
+
+DIP::Compositor::Compositor() : Compositor(MODE_COPY)
+{
+}
+
+DIP::Compositor::Compositor(Mode mode, unsigned char red, unsigned char green, unsigned char blue) :
+	m_mode(mode)
+{
+	// the pixels are stored as BGR
+	m_color[0] = blue;
+	m_color[1] = green;
+	m_color[2] = red;
+}
+
+DIP::Compositor::Mode DIP::Compositor::mode() const
+{
+	return m_mode;
+}
+
+bool DIP::Compositor::isBlending() const
+{
+	return m_mode != MODE_COPY;
+}
+
+const unsigned char *DIP::Compositor::color() const
+{
+	return m_color;
+}
+
+bool DIP::Compositor::isPremultiplied() const
+{
+	return m_premultiplied;
+}
+
+void DIP::Compositor::setPremultiplied(bool premultiplied)
+{
+	m_premultiplied = premultiplied;
+}
+
+void DIP::Compositor::backdrop(unsigned char *pixels, int width, int column, int row) const
+{
+	if (m_mode == MODE_COLOR) {
+		for (int x = 0; x < width; ++x) {
+			memcpy(pixels + x * 4, m_color, 3);
+		}
+		return;
+	}
+
+	// the squares are filled span by span
+	bool light = ((column / DIP_COMPOSITOR_CHECKERBOARD_SIZE) + (row / DIP_COMPOSITOR_CHECKERBOARD_SIZE)) % 2 == 0;
+	int x = 0;
+	while (x < width) {
+		int span = std::min(DIP_COMPOSITOR_CHECKERBOARD_SIZE - (column + x) % DIP_COMPOSITOR_CHECKERBOARD_SIZE, width - x);
+		memset(pixels + x * 4, light ? DIP_COMPOSITOR_CHECKERBOARD_LIGHT : DIP_COMPOSITOR_CHECKERBOARD_DARK, static_cast<size_t>(span) * 4);
+		light = !light;
+		x += span;
+	}
+}
+
+void DIP::Compositor::composite(unsigned char *pixels, int width, int column, int row) const
+{
+	if (m_mode == MODE_COPY) {
+		return;
+	}
+
+	unsigned char backdrop[CHUNK * 4];
+	for (int x = 0; x < width; x += CHUNK) {
+		int count = std::min(CHUNK, width - x);
+		this->backdrop(backdrop, count, column + x, row);
+		blend(pixels + x * 4, backdrop, count, m_premultiplied);
+	}
+}
+
+bool DIP::Compositor::isOpaque(const unsigned char *pixels, int width)
+{
+#ifdef DIP_COMPOSITOR_SSE2
+	return isOpaqueSse2(pixels, width);
+#else
+	return isOpaqueScalar(pixels, width);
+#endif
+}
+
+void DIP::Compositor::convert(const unsigned char *source, int source_channels, unsigned char *destination, int destination_channels, int width, int column, int row) const
+{
+	if (source_channels == destination_channels && (source_channels != 4 || m_mode == MODE_COPY)) {
+		memcpy(destination, source, static_cast<size_t>(width) * source_channels);
+		return;
+	}
+
+	if (source_channels == 4 && m_mode != MODE_COPY) {
+		// blended in place in the stack buffer, then the alpha is dropped if needed
+		unsigned char pixels[CHUNK * 4];
+		for (int x = 0; x < width; x += CHUNK) {
+			int count = std::min(CHUNK, width - x);
+			memcpy(pixels, source + x * 4, static_cast<size_t>(count) * 4);
+			this->composite(pixels, count, column + x, row);
+
+			unsigned char *result = destination + x * destination_channels;
+			if (destination_channels == 4) {
+				memcpy(result, pixels, static_cast<size_t>(count) * 4);
+				continue;
+			}
+			for (int i = 0; i < count; ++i) {
+				result[i * 3] = pixels[i * 4];
+				result[i * 3 + 1] = pixels[i * 4 + 1];
+				result[i * 3 + 2] = pixels[i * 4 + 2];
+			}
+		}
+		return;
+	}
+
+	for (int x = 0; x < width; ++x) {
+		const unsigned char *pixel = source + x * source_channels;
+		unsigned char *result = destination + x * destination_channels;
+
+		if (source_channels == 1) {
+			result[0] = result[1] = result[2] = pixel[0];
+		} else {
+			result[0] = pixel[0];
+			result[1] = pixel[1];
+			result[2] = pixel[2];
+		}
+
+		if (destination_channels == 4) {
+			result[3] = source_channels == 4 ? pixel[3] : 255;
+		}
+	}
+}
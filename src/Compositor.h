@@ -0,0 +1,57 @@
+#ifndef DIP_COMPOSITOR_H
+#define DIP_COMPOSITOR_H
+
+#include <cstddef>
+
+// the size of the checkerboard squares in pixels
+#define DIP_COMPOSITOR_CHECKERBOARD_SIZE 8
+#define DIP_COMPOSITOR_CHECKERBOARD_LIGHT 0xFF
+#define DIP_COMPOSITOR_CHECKERBOARD_DARK 0xCC
+
+namespace DIP {
+
+	// converts the rows of the 8-bit pixels (gray, BGR, BGRA) between the channel counts,
+	// the transparent pixels can be blended over the checkerboard or a color on the way
+	class Compositor
+	{
+	public:
+		enum Mode {
+			// the alpha is kept (or dropped for the destination without it)
+			MODE_COPY,
+			MODE_CHECKERBOARD,
+			MODE_COLOR
+		};
+
+		// the copying one
+		Compositor();
+		Compositor(Mode mode, unsigned char red = 0, unsigned char green = 0, unsigned char blue = 0);
+
+		Mode mode() const;
+		bool isBlending() const;
+		// the BGR background of MODE_COLOR
+		const unsigned char *color() const;
+
+		// the color channels of the source have been multiplied by the alpha already
+		bool isPremultiplied() const;
+		void setPremultiplied(bool premultiplied);
+
+		// the column and the row of the first pixel give the phase of the checkerboard
+		void convert(const unsigned char *source, int source_channels, unsigned char *destination, int destination_channels, int width, int column, int row) const;
+		// blends the BGRA row over the backdrop in place, the alpha becomes opaque, the opaque spans are skipped
+		void composite(unsigned char *pixels, int width, int column, int row) const;
+
+		// checks the alpha of the BGRA row, stops at the first transparent pixel
+		static bool isOpaque(const unsigned char *pixels, int width);
+
+	private:
+		// fills the BGRA row with the background
+		void backdrop(unsigned char *pixels, int width, int column, int row) const;
+
+		Mode m_mode;
+		bool m_premultiplied = false;
+		unsigned char m_color[3];
+	};
+
+} // namespace DIP
+
+#endif // DIP_COMPOSITOR_H
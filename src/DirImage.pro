@@ -56,7 +56,15 @@ SOURCES += \
 	Master.cpp \
 	HotKey.cpp \
 	Image.cpp \
-	FileIterator.cpp
+	ImageCache.cpp \
+	MemoryThumbCache.cpp \
+	FileIterator.cpp \
+	MappedFile.cpp \
+	Compositor.cpp \
+	Resampler.cpp \
+	ThreadPool.cpp \
+	ThumbCache.cpp \
+	XdgThumbCache.cpp
 
 HEADERS += \
 	INI.h \
@@ -69,7 +77,15 @@ HEADERS += \
 	Master.h \
 	HotKey.h \
 	Image.h \
-	FileIterator.h
+	ImageCache.h \
+	MemoryThumbCache.h \
+	FileIterator.h \
+	MappedFile.h \
+	Compositor.h \
+	Resampler.h \
+	ThreadPool.h \
+	ThumbCache.h \
+	XdgThumbCache.h
 
 DEF_FILE += DirImage.def
 
@@ -1,4 +1,13 @@
 #include "Image.h"
+#include "MappedFile.h"
+#include "Resampler.h"
+#include "ThreadPool.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 // FreeImage type is abstracted for a possible future replace
 #ifdef _WIN64
@@ -11,11 +20,147 @@
 #define FID static_cast<FIT *>(m_data)
 #define FIDF(source) static_cast<FIT *>(source)
 
+namespace {
+
+	// the image data source: a stream over the mapped file, so the format detection and the decoding share
+	// one open of the file, or the file itself if it cannot be mapped (FreeImage reads it on its own then,
+	// without the whole file in memory)
+	class Source
+	{
+	public:
+		// the stream positions of FreeImage are long, so the larger files are not mapped
+		Source(const wchar_t *filename, const std::atomic<bool> *cancelled = nullptr) : m_filename(filename), m_file(filename, DIP::MappedFile::MODE_MAP, 0x7FFFFFFF)
+		{
+			m_stream.cancelled = cancelled;
+			if (m_file.isValid()) {
+				m_stream.file = &m_file;
+				m_stream.size = m_file.size();
+				m_mapped = true;
+			}
+
+			m_io.read_proc = read;
+			m_io.write_proc = write;
+			m_io.seek_proc = seek;
+			m_io.tell_proc = tell;
+		}
+
+		bool isCancelled() const
+		{
+			return m_stream.cancelled && *m_stream.cancelled;
+		}
+
+		// the content of the mapped file, nullptr if the file is read by FreeImage itself,
+		// the pixel data is read by copy(), the access to the pages of an unreadable file is not guarded here
+		const BYTE *data() const
+		{
+			return m_mapped ? m_file.data() : nullptr;
+		}
+
+		bool copy(void *buffer, size_t offset, size_t size) const
+		{
+			return m_mapped && m_file.copy(buffer, offset, size);
+		}
+
+		size_t size() const
+		{
+			return m_mapped ? m_stream.size : 0;
+		}
+
+		FREE_IMAGE_FORMAT format() const
+		{
+			FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
+			if (m_mapped) {
+				m_stream.position = 0;
+				fif = FreeImage_GetFileTypeFromHandle(&m_io, &m_stream, 0);
+			} else {
+				fif = FreeImage_GetFileTypeU(m_filename, 0);
+			}
+			if (fif == FIF_UNKNOWN) {
+				fif = FreeImage_GetFIFFromFilenameU(m_filename);
+			}
+			return fif;
+		}
+
+		FIT *load(FREE_IMAGE_FORMAT fif, int flags = 0) const
+		{
+			if (this->isCancelled()) {
+				return nullptr;
+			}
+			if (m_mapped) {
+				m_stream.position = 0;
+				return FreeImage_LoadFromHandle(fif, &m_io, &m_stream, flags);
+			}
+			return FreeImage_LoadU(fif, m_filename, flags);
+		}
+
+	private:
+		struct Stream {
+			const DIP::MappedFile *file = nullptr;
+			size_t size = 0;
+			size_t position = 0;
+			const std::atomic<bool> *cancelled = nullptr;
+		};
+
+		// the decoders read the data in chunks, so the cancelled decoding runs out of the data within one chunk
+		static unsigned DLL_CALLCONV read(void *buffer, unsigned size, unsigned count, fi_handle handle)
+		{
+			Stream *stream = static_cast<Stream *>(handle);
+			if (size == 0 || (stream->cancelled && *stream->cancelled)) {
+				return 0;
+			}
+			size_t items = min(static_cast<size_t>(count), (stream->size - stream->position) / size);
+			// the page that cannot be read in ends the data like the end of the file
+			if (stream->file->copy(buffer, stream->position, items * size) == false) {
+				stream->position = stream->size;
+				return 0;
+			}
+			stream->position += items * size;
+			return static_cast<unsigned>(items);
+		}
+
+		static unsigned DLL_CALLCONV write(void * /*buffer*/, unsigned /*size*/, unsigned /*count*/, fi_handle /*handle*/)
+		{
+			return 0;
+		}
+
+		static int DLL_CALLCONV seek(fi_handle handle, long offset, int origin)
+		{
+			Stream *stream = static_cast<Stream *>(handle);
+			long long position = offset;
+			if (origin == SEEK_CUR) {
+				position += stream->position;
+			} else if (origin == SEEK_END) {
+				position += stream->size;
+			}
+			if (position < 0 || position > static_cast<long long>(stream->size)) {
+				return -1;
+			}
+			stream->position = static_cast<size_t>(position);
+			return 0;
+		}
+
+		static long DLL_CALLCONV tell(fi_handle handle)
+		{
+			return static_cast<long>(static_cast<Stream *>(handle)->position);
+		}
+
+		const wchar_t *m_filename;
+		DIP::MappedFile m_file;
+		bool m_mapped = false;
+		mutable Stream m_stream;
+		mutable FreeImageIO m_io;
+	};
+
+} // namespace
+
 DIP::Image::Image()
 {
 	m_data = nullptr;
 	m_width = 0;
 	m_height = 0;
+	m_source_width = 0;
+	m_source_height = 0;
+	m_opaque = true;
 }
 
 DIP::Image::Image(int width, int height, BYTE red, BYTE green, BYTE blue)
@@ -40,33 +185,1106 @@ DIP::Image::Image(int width, int height, const RGBQUAD &color)
 	FreeImage_FillBackground(FID, &color);
 }
 
+DIP::Image::Image(int width, int height, int channels, const unsigned char *pixels)
+{
+	// the 8-bit bitmaps get the grayscale palette
+	m_data = FreeImage_Allocate(width, height, channels * 8);
+	if (m_data) {
+		size_t length = static_cast<size_t>(width) * channels;
+		for (int line = 0; line < height; ++line) {
+			memcpy(FreeImage_GetScanLine(FID, line), pixels + line * length, length);
+		}
+		if (channels == 4) {
+			FreeImage_SetTransparent(FID, TRUE);
+		}
+	}
+	this->updateMetrics();
+}
+
+DIP::Image::Image(int width, int height, int channels, const std::function<bool (int line, unsigned char *row)> &fill)
+{
+	m_data = FreeImage_Allocate(width, height, channels * 8);
+	for (int line = 0; m_data && line < height; ++line) {
+		if (fill(line, FreeImage_GetScanLine(FID, line)) == false) {
+			FreeImage_Unload(FID);
+			m_data = nullptr;
+		}
+	}
+	if (m_data && channels == 4) {
+		FreeImage_SetTransparent(FID, TRUE);
+	}
+	this->updateMetrics();
+}
+
 DIP::Image::Image(const wchar_t *filename)
 {
-	FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeU(filename, 0);
-	if (fif == FIF_UNKNOWN) {
-		fif = FreeImage_GetFIFFromFilenameU(filename);
+	this->load(filename);
+}
+
+DIP::Image::Image(const wchar_t *filename, int width, int height, const std::atomic<bool> *cancelled)
+{
+	this->load(filename, width, height, cancelled);
+}
+
+// returns the load flags that make the decoder skip the pixels not needed for the given box
+static int reductionFlags(FREE_IMAGE_FORMAT fif, int width, int height)
+{
+	// the longest side is enough - an image reduced to it still covers any size inscribed into the box
+	int size = max(width, height);
+	if (size <= 0) {
+		return 0;
+	}
+
+	switch (fif) {
+		case FIF_JPEG:
+			// DCT scaling by 1/2, 1/4 or 1/8, the required size is passed in the high word of the flags
+			return JPEG_DEFAULT | (size << 16);
+
+		case FIF_RAW:
+			return size <= DIP_IMAGE_RAW_HALFSIZE_LIMIT ? RAW_HALFSIZE : RAW_DEFAULT;
+
+		case FIF_PCD:
+			if (size <= 192) {
+				return PCD_BASEDIV16;
+			}
+			if (size <= 384) {
+				return PCD_BASEDIV4;
+			}
+			return PCD_DEFAULT;
+
+		default:
+			return 0;
+	}
+}
+
+// returns the load flags that keep the pixels in their own color model, so they are converted after the reduction
+static int conversionFlags(FREE_IMAGE_FORMAT fif)
+{
+	// the CMYK JPEG is left to FreeImage, which knows the inverted Adobe variant
+	return fif == FIF_TIFF ? TIFF_CMYK : 0;
+}
+
+namespace {
+
+	// averages the blocks of factor x factor pixels of the image with the given sample type in its own format, the sums
+	// are kept in doubles, the blocks on the edges may be smaller
+	template <typename T>
+	FIT *reduceBlocks(FIT *source, int factor, int channels)
+	{
+		int source_width = FreeImage_GetWidth(source);
+		int source_height = FreeImage_GetHeight(source);
+		int width = (source_width + factor - 1) / factor;
+		int height = (source_height + factor - 1) / factor;
+
+		FIT *result = FreeImage_AllocateT(FreeImage_GetImageType(source), width, height, FreeImage_GetBPP(source));
+		if (result == nullptr) {
+			return nullptr;
+		}
+
+		std::vector<double> sums(static_cast<size_t>(width) * channels);
+		for (int y = 0; y < height; ++y) {
+			int rows = min(factor, source_height - y * factor);
+			sums.assign(sums.size(), 0.0);
+
+			for (int line = y * factor; line < y * factor + rows; ++line) {
+				const T *samples = reinterpret_cast<const T *>(FreeImage_GetScanLine(source, line));
+				for (int x = 0; x < source_width; ++x) {
+					double *sum = &sums[static_cast<size_t>(x / factor) * channels];
+					for (int c = 0; c < channels; ++c) {
+						sum[c] += samples[x * channels + c];
+					}
+				}
+			}
+
+			T *samples = reinterpret_cast<T *>(FreeImage_GetScanLine(result, y));
+			for (int x = 0; x < width; ++x) {
+				double area = static_cast<double>(min(factor, source_width - x * factor) * rows);
+				for (int c = 0; c < channels; ++c) {
+					double value = sums[static_cast<size_t>(x) * channels + c] / area;
+					// the integer samples are rounded
+					samples[x * channels + c] = static_cast<T>(std::numeric_limits<T>::is_integer ? value + 0.5 : value);
+				}
+			}
+		}
+
+		return result;
+	}
+
+	// the CMYK of 8 or 16 bits per sample to BGR, as FreeImage does it
+	FIT *convertCmyk(FIT *source)
+	{
+		bool wide = FreeImage_GetImageType(source) == FIT_RGBA16;
+		int width = FreeImage_GetWidth(source);
+		int height = FreeImage_GetHeight(source);
+
+		FIT *result = FreeImage_Allocate(width, height, 24);
+		if (result == nullptr) {
+			return nullptr;
+		}
+
+		for (int y = 0; y < height; ++y) {
+			const BYTE *bytes = FreeImage_GetScanLine(source, y);
+			const WORD *words = reinterpret_cast<const WORD *>(bytes);
+			BYTE *line = FreeImage_GetScanLine(result, y);
+			for (int x = 0; x < width; ++x) {
+				unsigned int cmyk[4];
+				for (int c = 0; c < 4; ++c) {
+					cmyk[c] = wide ? words[x * 4 + c] >> 8 : bytes[x * 4 + c];
+				}
+				unsigned int k = 255 - cmyk[3];
+				line[x * 3 + FI_RGBA_RED] = static_cast<BYTE>((255 - cmyk[0]) * k / 255);
+				line[x * 3 + FI_RGBA_GREEN] = static_cast<BYTE>((255 - cmyk[1]) * k / 255);
+				line[x * 3 + FI_RGBA_BLUE] = static_cast<BYTE>((255 - cmyk[2]) * k / 255);
+			}
+		}
+
+		return result;
+	}
+
+	// converts the small image to 8 bits per channel, the HDR ones are tone mapped
+	FIT *convertStandard(FIT *source, bool cmyk)
+	{
+		if (cmyk) {
+			return convertCmyk(source);
+		}
+
+		switch (FreeImage_GetImageType(source)) {
+			case FIT_RGBF:
+			case FIT_RGBAF: {
+				FIT *mapped = FreeImage_ToneMapping(source, FITMO_DRAGO03);
+				return mapped ? mapped : FreeImage_ConvertToStandardType(source, TRUE);
+			}
+
+			case FIT_UINT16:
+				return FreeImage_ConvertTo8Bits(source);
+
+			case FIT_RGB16:
+				return FreeImage_ConvertTo24Bits(source);
+
+			case FIT_RGBA16:
+				return FreeImage_ConvertTo32Bits(source);
+
+			default:
+				return FreeImage_ConvertToStandardType(source, TRUE);
+		}
+	}
+
+} // namespace
+
+// reduces the images with more than 8 bits per channel or CMYK ones to the size that still covers the box, then
+// converts them to 8 bits per channel, returns nullptr for the standard images
+static FIT *standardize(FIT *source, int width, int height)
+{
+	FREE_IMAGE_TYPE type = FreeImage_GetImageType(source);
+	bool cmyk = FreeImage_GetColorType(source) == FIC_CMYK;
+	if (type == FIT_BITMAP && cmyk == false) {
+		return nullptr;
+	}
+
+	int size = max(width, height);
+	int factor = size > 0 ? static_cast<int>(max(FreeImage_GetWidth(source), FreeImage_GetHeight(source))) / size : 1;
+
+	FIT *reduced = nullptr;
+	if (factor >= 2) {
+		switch (type) {
+			case FIT_BITMAP:
+				reduced = FreeImage_GetBPP(source) == 32 ? reduceBlocks<BYTE>(source, factor, 4) : nullptr;
+				break;
+			case FIT_UINT16:
+				reduced = reduceBlocks<WORD>(source, factor, 1);
+				break;
+			case FIT_RGB16:
+				reduced = reduceBlocks<WORD>(source, factor, 3);
+				break;
+			case FIT_RGBA16:
+				reduced = reduceBlocks<WORD>(source, factor, 4);
+				break;
+			case FIT_FLOAT:
+				reduced = reduceBlocks<float>(source, factor, 1);
+				break;
+			case FIT_RGBF:
+				reduced = reduceBlocks<float>(source, factor, 3);
+				break;
+			case FIT_RGBAF:
+				reduced = reduceBlocks<float>(source, factor, 4);
+				break;
+			default:
+				break;
+		}
+	}
+
+	// the reduced image has no ICC profile, so the color model is passed along
+	FIT *result = convertStandard(reduced ? reduced : source, cmyk);
+	FreeImage_Unload(reduced);
+	return result;
+}
+
+static int metadataValue(FIT *dib, FREE_IMAGE_MDMODEL model, const char *key, int default_value = 0)
+{
+	FITAG *tag = nullptr;
+	if (FreeImage_GetMetadata(model, dib, key, &tag) == false || tag == nullptr) {
+		return default_value;
+	}
+
+	const void *value = FreeImage_GetTagValue(tag);
+	switch (FreeImage_GetTagType(tag)) {
+		case FIDT_ASCII:
+			return atoi(static_cast<const char *>(value));
+
+		case FIDT_SHORT:
+			return *static_cast<const WORD *>(value);
+
+		case FIDT_LONG:
+			return static_cast<int>(*static_cast<const DWORD *>(value));
+
+		default:
+			return default_value;
+	}
+}
+
+// the EXIF orientation (1 - 8) of the formats that keep the pixels unrotated, 1 for the others
+static int readOrientation(FIT *dib, FREE_IMAGE_FORMAT fif)
+{
+	if (fif != FIF_JPEG && fif != FIF_TIFF) {
+		return 1;
+	}
+	int orientation = metadataValue(dib, FIMD_EXIF_MAIN, "Orientation", 1);
+	return orientation >= 1 && orientation <= 8 ? orientation : 1;
+}
+
+// loads the thumbnail embedded into the file (EXIF, PSD resources, etc.) without decoding the pixels,
+// returns nullptr if there is no thumbnail or it is not enough for the given box
+static FIT *loadEmbeddedThumbnail(const Source &source, FREE_IMAGE_FORMAT fif, int width, int height, int &source_width, int &source_height, int &orientation)
+{
+	// no box means the full image
+	if (max(width, height) <= 0 || max(width, height) > DIP_IMAGE_EMBEDDED_THUMBNAIL_LIMIT || FreeImage_FIFSupportsNoPixels(fif) == false) {
+		return nullptr;
+	}
+
+	FIT *header = source.load(fif, FIF_LOAD_NOPIXELS);
+	if (header == nullptr) {
+		return nullptr;
+	}
+
+	FIT *result = nullptr;
+	FIT *thumbnail = FreeImage_GetThumbnail(header);
+	if (thumbnail) {
+		int header_width = FreeImage_GetWidth(header);
+		int header_height = FreeImage_GetHeight(header);
+		int thumbnail_width = FreeImage_GetWidth(thumbnail);
+		int thumbnail_height = FreeImage_GetHeight(thumbnail);
+
+		// the box is given in the oriented dimensions, the thumbnail is stored as the main image is
+		int header_orientation = readOrientation(header, fif);
+		if (header_orientation >= 5) {
+			std::swap(width, height);
+		}
+
+		if (header_width > 0 && header_height > 0 && thumbnail_width > 0 && thumbnail_height > 0) {
+			float scale = min(static_cast<float>(width) / header_width, static_cast<float>(height) / header_height);
+			float aspect = (static_cast<float>(thumbnail_width) / thumbnail_height) / (static_cast<float>(header_width) / header_height);
+			// some cameras pad the thumbnail with black bars, such one is useless
+			if (aspect > 0.97f && aspect < 1.03f && header_width * scale <= thumbnail_width && header_height * scale <= thumbnail_height) {
+				result = FreeImage_Clone(thumbnail);
+				source_width = header_width;
+				source_height = header_height;
+				orientation = header_orientation;
+			}
+		}
 	}
+
+	FreeImage_Unload(header);
+	return result;
+}
+
+namespace {
+
+	// averages the blocks of factor x factor pixels of the rows pushed top-down, so only one row of the sums is kept,
+	// the blocks on the right and bottom edges may be smaller
+	class BoxReducer
+	{
+	public:
+		BoxReducer(int source_width, int source_height, int factor, int channels) :
+			m_source_width(source_width),
+			m_source_height(source_height),
+			m_factor(factor),
+			m_channels(channels)
+		{
+			m_width = (source_width + factor - 1) / factor;
+			m_height = (source_height + factor - 1) / factor;
+			m_sums.assign(static_cast<size_t>(m_width) * channels, 0);
+			m_result = FreeImage_Allocate(m_width, m_height, channels * 8);
+		}
+
+		~BoxReducer()
+		{
+			FreeImage_Unload(m_result);
+		}
+
+		bool isValid() const
+		{
+			return m_result != nullptr;
+		}
+
+		void push(const BYTE *row)
+		{
+			for (int x = 0; x < m_source_width; ++x) {
+				unsigned int *sum = &m_sums[static_cast<size_t>(x / m_factor) * m_channels];
+				for (int c = 0; c < m_channels; ++c) {
+					sum[c] += row[x * m_channels + c];
+				}
+			}
+
+			++m_row;
+			if (m_row % m_factor != 0 && m_row != m_source_height) {
+				return;
+			}
+
+			// the image is stored bottom-up
+			int y = (m_row - 1) / m_factor;
+			int rows = m_row - y * m_factor;
+			BYTE *bits = FreeImage_GetScanLine(m_result, m_height - 1 - y);
+			for (int x = 0; x < m_width; ++x) {
+				unsigned int count = static_cast<unsigned int>(min(m_factor, m_source_width - x * m_factor) * rows);
+				for (int c = 0; c < m_channels; ++c) {
+					unsigned int &sum = m_sums[static_cast<size_t>(x) * m_channels + c];
+					bits[x * m_channels + c] = static_cast<BYTE>((sum + count / 2) / count);
+					sum = 0;
+				}
+			}
+		}
+
+		// the ownership of the image passes to the caller
+		FIT *release()
+		{
+			FIT *result = m_result;
+			m_result = nullptr;
+			return result;
+		}
+
+	private:
+		int m_source_width;
+		int m_source_height;
+		int m_factor;
+		int m_channels;
+		int m_width = 0;
+		int m_height = 0;
+		int m_row = 0;
+		std::vector<unsigned int> m_sums;
+		FIT *m_result = nullptr;
+	};
+
+	// the layout of the rows of an uncompressed raster in the mapped file
+	struct Raster {
+		int width = 0;
+		int height = 0;
+		int bpp = 0;
+		size_t offset = 0;
+		size_t pitch = 0;
+		bool bottom_up = false;
+		// BGR, RGB for the PNM
+		bool rgb = false;
+		const BYTE *palette = nullptr;
+		int colors = 0;
+	};
+
+	template <typename T>
+	T readValue(const BYTE *data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	// the rows fit into the file, without the overflow on x32
+	bool isInside(const Raster &raster, size_t size)
+	{
+		return raster.offset <= size && raster.pitch > 0 && static_cast<size_t>(raster.height) <= (size - raster.offset) / raster.pitch;
+	}
+
+	// the uncompressed BMP with 1, 4, 8, 24 or 32 (the 4th byte is unused) bits per pixel
+	bool parseBitmap(const BYTE *data, size_t size, Raster &raster)
+	{
+		if (size < 14 + sizeof(BITMAPINFOHEADER) || data[0] != 'B' || data[1] != 'M') {
+			return false;
+		}
+
+		BITMAPINFOHEADER header;
+		memcpy(&header, data + 14, sizeof(header));
+		if (header.biSize < sizeof(BITMAPINFOHEADER) || header.biCompression != BI_RGB || header.biWidth <= 0 || header.biHeight == 0) {
+			return false;
+		}
+		if (header.biBitCount != 1 && header.biBitCount != 4 && header.biBitCount != 8 && header.biBitCount != 24 && header.biBitCount != 32) {
+			return false;
+		}
+
+		raster.width = header.biWidth;
+		raster.height = header.biHeight > 0 ? header.biHeight : -header.biHeight;
+		raster.bpp = header.biBitCount;
+		raster.offset = readValue<DWORD>(data + 10);
+		raster.pitch = ((static_cast<size_t>(raster.width) * raster.bpp + 31) / 32) * 4;
+		raster.bottom_up = header.biHeight > 0;
+
+		if (raster.bpp <= 8) {
+			raster.colors = header.biClrUsed ? static_cast<int>(min(header.biClrUsed, 256UL)) : 1 << raster.bpp;
+			size_t palette = 14 + static_cast<size_t>(header.biSize);
+			if (palette + raster.colors * 4 > size) {
+				return false;
+			}
+			raster.palette = data + palette;
+		}
+
+		return isInside(raster, size);
+	}
+
+	// skips the whitespaces and the comments of the PNM header, then reads a number
+	bool readNumber(const BYTE *data, size_t size, size_t &position, int &value)
+	{
+		while (position < size && (isspace(data[position]) || data[position] == '#')) {
+			if (data[position] == '#') {
+				while (position < size && data[position] != '\n') {
+					++position;
+				}
+			} else {
+				++position;
+			}
+		}
+
+		value = 0;
+		size_t start = position;
+		while (position < size && isdigit(data[position]) && value < 0x1000000) {
+			value = value * 10 + (data[position++] - '0');
+		}
+		return position > start;
+	}
+
+	// the binary PGM and PPM with 8 bits per channel
+	bool parsePixmap(const BYTE *data, size_t size, Raster &raster)
+	{
+		if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+			return false;
+		}
+
+		size_t position = 2;
+		int maximum = 0;
+		if (readNumber(data, size, position, raster.width) == false || readNumber(data, size, position, raster.height) == false
+			|| readNumber(data, size, position, maximum) == false || maximum != 255 || raster.width <= 0 || raster.height <= 0) {
+			return false;
+		}
+
+		// a single whitespace separates the header from the pixels
+		raster.bpp = data[1] == '5' ? 8 : 24;
+		raster.offset = position + 1;
+		raster.pitch = static_cast<size_t>(raster.width) * (raster.bpp / 8);
+		raster.rgb = true;
+
+		return isInside(raster, size);
+	}
+
+	bool isGrayPalette(const Raster &raster)
+	{
+		for (int i = 0; i < raster.colors; ++i) {
+			const BYTE *color = raster.palette + i * 4;
+			if (color[0] != color[1] || color[1] != color[2]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+} // namespace
+
+// decodes the uncompressed rasters row by row straight into the image reduced by an integer factor, so the full image
+// is never resident, the reduced one still covers the box, returns nullptr for the other files or the small images
+static FIT *loadStreamed(const Source &source, FREE_IMAGE_FORMAT fif, int width, int height, int &source_width, int &source_height, const std::atomic<bool> *cancelled)
+{
+	int size = max(width, height);
+	const BYTE *data = source.data();
+	if (size <= 0 || data == nullptr) {
+		return nullptr;
+	}
+
+	Raster raster;
+	bool parsed = false;
+	switch (fif) {
+		case FIF_BMP:
+			parsed = parseBitmap(data, source.size(), raster);
+			break;
+
+		case FIF_PGMRAW:
+		case FIF_PPMRAW:
+			parsed = parsePixmap(data, source.size(), raster);
+			break;
+
+		default:
+			break;
+	}
+
+	// the sums of the blocks fit into 32 bits
+	int factor = parsed ? min(max(raster.width, raster.height) / size, 4096) : 0;
+	if (factor < 2) {
+		return nullptr;
+	}
+
+	bool indexed = raster.bpp <= 8 && raster.palette;
+	int channels = raster.bpp == 8 && indexed == false ? 1 : (indexed && isGrayPalette(raster) ? 1 : 3);
+
+	BoxReducer reducer(raster.width, raster.height, factor, channels);
+	if (reducer.isValid() == false) {
+		return nullptr;
+	}
+
+	std::vector<BYTE> row(static_cast<size_t>(raster.width) * channels);
+	std::vector<BYTE> line_buffer(raster.pitch);
+	const BYTE *line = line_buffer.data();
+	int mask = (1 << raster.bpp) - 1;
+
+	for (int y = 0; y < raster.height; ++y) {
+		if (cancelled && *cancelled) {
+			return nullptr;
+		}
+
+		size_t offset = raster.offset + raster.pitch * (raster.bottom_up ? raster.height - 1 - y : y);
+		if (source.copy(line_buffer.data(), offset, raster.pitch) == false) {
+			return nullptr;
+		}
+
+		if (indexed) {
+			for (int x = 0; x < raster.width; ++x) {
+				int bit = x * raster.bpp;
+				int index = (line[bit / 8] >> (8 - raster.bpp - bit % 8)) & mask;
+				const BYTE *color = raster.palette + min(index, raster.colors - 1) * 4;
+				memcpy(&row[static_cast<size_t>(x) * channels], color, channels);
+			}
+		} else if (channels == 1) {
+			memcpy(row.data(), line, row.size());
+		} else {
+			int step = raster.bpp / 8;
+			for (int x = 0; x < raster.width; ++x) {
+				const BYTE *pixel = line + x * step;
+				BYTE *result = &row[static_cast<size_t>(x) * 3];
+				result[0] = pixel[raster.rgb ? 2 : 0];
+				result[1] = pixel[1];
+				result[2] = pixel[raster.rgb ? 0 : 2];
+			}
+		}
+
+		reducer.push(row.data());
+	}
+
+	source_width = raster.width;
+	source_height = raster.height;
+	return reducer.release();
+}
+
+void DIP::Image::load(const wchar_t *filename, int width, int height, const std::atomic<bool> *cancelled)
+{
+	m_data = nullptr;
+
+	Source source(filename, cancelled);
+	FREE_IMAGE_FORMAT fif = source.format();
 	if ((fif != FIF_UNKNOWN) && FreeImage_FIFSupportsReading(fif)) {
-		m_data = FreeImage_LoadU(fif, filename);
+		int source_width = 0;
+		int source_height = 0;
+		m_data = loadEmbeddedThumbnail(source, fif, width, height, source_width, source_height, m_orientation);
+		if (m_data) {
+			this->updateMetrics();
+			m_source_width = source_width;
+			m_source_height = source_height;
+			return;
+		}
+
+		// the large uncompressed rasters are reduced on the fly
+		m_data = loadStreamed(source, fif, width, height, source_width, source_height, cancelled);
+		if (m_data) {
+			this->updateMetrics();
+			m_source_width = source_width;
+			m_source_height = source_height;
+			return;
+		}
+
+		int flags = reductionFlags(fif, width, height);
+		m_data = source.load(fif, flags | conversionFlags(fif));
+
+		// the decoding cut short leaves a partial image
+		if (m_data && source.isCancelled()) {
+			FreeImage_Unload(FID);
+			m_data = nullptr;
+		}
+
+		// the pixels stay as decoded, the thumbnails are turned after the scaling
+		m_orientation = m_data ? readOrientation(FID, fif) : 1;
+
+		int decoded_width = m_data ? static_cast<int>(FreeImage_GetWidth(FID)) : 0;
+		int decoded_height = m_data ? static_cast<int>(FreeImage_GetHeight(FID)) : 0;
+
+		// the wide and CMYK pixels are reduced in their own format first, so only the small image is converted
+		FIT *standard = m_data ? standardize(FID, width, height) : nullptr;
+		if (standard) {
+			FreeImage_Unload(FID);
+			m_data = standard;
+		}
+
 		this->updateMetrics();
+
+		if (standard) {
+			m_source_width = decoded_width;
+			m_source_height = decoded_height;
+		}
+
+		if (m_data == nullptr || flags == 0) {
+			return;
+		}
+
+		// restore the original dimensions of the reduced image
+		switch (fif) {
+			case FIF_JPEG:
+				m_source_width = metadataValue(FID, FIMD_COMMENTS, "OriginalJPEGWidth", m_width);
+				m_source_height = metadataValue(FID, FIMD_COMMENTS, "OriginalJPEGHeight", m_height);
+				break;
+
+			case FIF_RAW:
+				m_source_width = decoded_width * 2;
+				m_source_height = decoded_height * 2;
+				break;
+
+			case FIF_PCD: {
+				int factor = flags == PCD_BASEDIV16 ? 4 : (flags == PCD_BASEDIV4 ? 2 : 1);
+				m_source_width = m_width * factor;
+				m_source_height = m_height * factor;
+				break;
+			}
+
+			default:
+				break;
+		}
 		return;
 	}
-	m_data = nullptr;
-	m_width = 0;
-	m_height = 0;
+	this->updateMetrics();
 }
 
 void DIP::Image::updateMetrics()
 {
 	m_width = FreeImage_GetWidth(FID);
 	m_height = FreeImage_GetHeight(FID);
+	m_source_width = m_width;
+	m_source_height = m_height;
+	m_opaque = this->scanOpacity();
 }
 
 DIP::Image::~Image()
 {
+	for (DIP::Image *mipmap : m_mipmaps) {
+		delete mipmap;
+	}
 	FreeImage_Unload(FID);
 }
 
+// the number of the channels of the images the resampler works with, 0 for the others
+static int resamplerChannels(FIT *source)
+{
+	if (FreeImage_GetImageType(source) != FIT_BITMAP) {
+		return 0;
+	}
+	switch (FreeImage_GetBPP(source)) {
+		case 32:
+			return 4;
+		case 24:
+			return 3;
+		case 8:
+			return FreeImage_GetColorType(source) == FIC_MINISBLACK && FreeImage_IsTransparent(source) == false ? 1 : 0;
+		default:
+			return 0;
+	}
+}
+
+namespace {
+
+	// reads the rows of the source for the resampler, the palette images (1, 4 and 8 bits) are expanded to gray,
+	// BGR or BGRA row by row, so the whole image is never promoted
+	class RowSource
+	{
+	public:
+		explicit RowSource(FIT *source) :
+			m_bits(FreeImage_GetBits(source)),
+			m_pitch(FreeImage_GetPitch(source)),
+			m_width(static_cast<int>(FreeImage_GetWidth(source))),
+			m_bpp(static_cast<int>(FreeImage_GetBPP(source)))
+		{
+			m_channels = resamplerChannels(source);
+			if (m_channels || FreeImage_GetImageType(source) != FIT_BITMAP || (m_bpp != 1 && m_bpp != 4 && m_bpp != 8)) {
+				return;
+			}
+
+			const RGBQUAD *palette = FreeImage_GetPalette(source);
+			if (palette == nullptr) {
+				return;
+			}
+
+			int colors = static_cast<int>(FreeImage_GetColorsUsed(source));
+			const BYTE *table = FreeImage_IsTransparent(source) ? FreeImage_GetTransparencyTable(source) : nullptr;
+			int transparent = table ? static_cast<int>(FreeImage_GetTransparencyCount(source)) : 0;
+
+			bool gray = true;
+			for (int i = 0; i < colors; ++i) {
+				gray = gray && palette[i].rgbRed == palette[i].rgbGreen && palette[i].rgbGreen == palette[i].rgbBlue;
+			}
+			m_channels = transparent ? 4 : (gray ? 1 : 3);
+
+			for (int i = 0; i < 256; ++i) {
+				const RGBQUAD &color = palette[min(i, colors - 1)];
+				BYTE *entry = m_palette[i];
+				if (m_channels == 1) {
+					entry[0] = color.rgbBlue;
+				} else {
+					entry[0] = color.rgbBlue;
+					entry[1] = color.rgbGreen;
+					entry[2] = color.rgbRed;
+					entry[3] = i < transparent ? table[i] : 255;
+				}
+			}
+			m_indexed = true;
+		}
+
+		// 0 for the unsupported formats
+		int channels() const
+		{
+			return m_channels;
+		}
+
+		DIP::Resampler::RowReader reader() const
+		{
+			return [this] (int y, unsigned char *buffer) {
+				return this->row(y, buffer);
+			};
+		}
+
+	private:
+		const BYTE *row(int y, BYTE *buffer) const
+		{
+			const BYTE *line = m_bits + y * m_pitch;
+			if (m_indexed == false) {
+				return line;
+			}
+
+			if (m_bpp == 8) {
+				for (int x = 0; x < m_width; ++x) {
+					memcpy(buffer + x * m_channels, m_palette[line[x]], m_channels);
+				}
+				return buffer;
+			}
+
+			int mask = (1 << m_bpp) - 1;
+			for (int x = 0; x < m_width; ++x) {
+				int bit = x * m_bpp;
+				memcpy(buffer + x * m_channels, m_palette[(line[bit / 8] >> (8 - m_bpp - bit % 8)) & mask], m_channels);
+			}
+			return buffer;
+		}
+
+		const BYTE *m_bits;
+		size_t m_pitch;
+		int m_width;
+		int m_bpp;
+		int m_channels = 0;
+		bool m_indexed = false;
+		BYTE m_palette[256][4];
+	};
+
+	// the parallel bit count, compiled to a few instructions without the intrinsics
+	inline unsigned int popcount(uint64_t value)
+	{
+		value -= (value >> 1) & 0x5555555555555555ULL;
+		value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+		value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return static_cast<unsigned int>((value * 0x0101010101010101ULL) >> 56);
+	}
+
+	// the number of the set bits in the range of the row, the whole bytes are counted 8 at a time
+	unsigned int countBits(const BYTE *row, int start, int length)
+	{
+		unsigned int count = 0;
+		int bit = start;
+		int end = start + length;
+
+		for (; bit < end && bit % 8 != 0; ++bit) {
+			count += (row[bit / 8] >> (7 - bit % 8)) & 1;
+		}
+		for (; bit + 64 <= end; bit += 64) {
+			uint64_t word;
+			memcpy(&word, row + bit / 8, sizeof(word));
+			count += popcount(word);
+		}
+		for (; bit + 8 <= end; bit += 8) {
+			count += popcount(row[bit / 8]);
+		}
+		for (; bit < end; ++bit) {
+			count += (row[bit / 8] >> (7 - bit % 8)) & 1;
+		}
+		return count;
+	}
+
+} // namespace
+
+// averages the blocks of factor x factor pixels of the gray 1-bit image into the 8-bit one by counting
+// the set bits, the blocks on the edges may be smaller, returns nullptr for the other images
+static FIT *reduceBilevel(FIT *source, int factor)
+{
+	const RGBQUAD *palette = FreeImage_GetPalette(source);
+	if (FreeImage_GetBPP(source) != 1 || palette == nullptr || FreeImage_IsTransparent(source)) {
+		return nullptr;
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (palette[i].rgbRed != palette[i].rgbGreen || palette[i].rgbGreen != palette[i].rgbBlue) {
+			return nullptr;
+		}
+	}
+
+	int source_width = FreeImage_GetWidth(source);
+	int source_height = FreeImage_GetHeight(source);
+	int width = (source_width + factor - 1) / factor;
+	int height = (source_height + factor - 1) / factor;
+
+	// the grayscale palette is set by default
+	FIT *result = FreeImage_Allocate(width, height, 8);
+	if (result == nullptr) {
+		return nullptr;
+	}
+
+	unsigned int black = palette[0].rgbBlue;
+	unsigned int white = palette[1].rgbBlue;
+	std::vector<unsigned int> ones(width);
+
+	for (int y = 0; y < height; ++y) {
+		int rows = min(factor, source_height - y * factor);
+		ones.assign(width, 0);
+		for (int line = y * factor; line < y * factor + rows; ++line) {
+			const BYTE *bits = FreeImage_GetScanLine(source, line);
+			for (int x = 0; x < width; ++x) {
+				ones[x] += countBits(bits, x * factor, min(factor, source_width - x * factor));
+			}
+		}
+
+		BYTE *bits = FreeImage_GetScanLine(result, y);
+		for (int x = 0; x < width; ++x) {
+			unsigned int area = static_cast<unsigned int>(min(factor, source_width - x * factor) * rows);
+			bits[x] = static_cast<BYTE>((ones[x] * white + (area - ones[x]) * black + area / 2) / area);
+		}
+	}
+
+	return result;
+}
+
+static FIT *rescale(FIT *source, int width, int height, int filter);
+static FIT *halve(FIT *source);
+
+// runs the job over the bands of the rows [0, height) on the thread pool, the calling thread takes the first band
+// and helps with the others if it is a worker itself
+static void parallelRows(size_t pixels, int height, const std::function<void(int, int)> &job)
+{
+	DIP::ThreadPool &pool = DIP::ThreadPool::instance();
+
+	size_t bands = min(pool.size(), pixels / DIP_IMAGE_BAND_PIXELS);
+	bands = min(bands, static_cast<size_t>(height / DIP_IMAGE_BAND_ROWS));
+	if (bands < 2) {
+		job(0, height);
+		return;
+	}
+
+	int count = static_cast<int>(bands);
+	DIP::ThreadPool::Group group;
+	for (int i = 1; i < count; ++i) {
+		int first = height * i / count;
+		int last = height * (i + 1) / count;
+		pool.submit(group, [&job, first, last] {
+			job(first, last);
+		});
+	}
+
+	try {
+		job(0, height / count);
+	} catch (...) {
+		// the bands refer to the group on the stack
+		pool.wait(group);
+		throw;
+	}
+	pool.wait(group);
+}
+
+// resamples the source straight into the rectangle of the destination (the top-left origin as FreeImage_Paste has),
+// the pixels are converted to the destination format in the same pass, returns false for the unsupported formats
+static bool render(FIT *source, FIT *destination, int x, int y, int width, int height, int filter, const DIP::Compositor &compositor)
+{
+	bool prescale = (filter & DIP_IMAGE_FILTER_AUTO) != 0;
+
+	RowSource rows(source);
+	int channels = rows.channels();
+	int destination_channels = resamplerChannels(destination);
+	int destination_width = FreeImage_GetWidth(destination);
+	int destination_height = FreeImage_GetHeight(destination);
+
+	if (channels == 0 || destination_channels == 0 || (destination_channels == 1 && channels != 1) || width <= 0 || height <= 0
+		|| x < 0 || y < 0 || x + width > destination_width || y + height > destination_height) {
+		return false;
+	}
+
+	int source_width = FreeImage_GetWidth(source);
+	int source_height = FreeImage_GetHeight(source);
+
+	// the bilevel images are reduced by the area averaging first, whatever the filter is
+	int area_factor = min(source_width / width, source_height / height);
+	if (FreeImage_GetBPP(source) == 1 && area_factor >= 2) {
+		FIT *reduced = reduceBilevel(source, area_factor);
+		if (reduced) {
+			bool result = render(reduced, destination, x, y, width, height, filter, compositor);
+			FreeImage_Unload(reduced);
+			return result;
+		}
+	}
+
+	filter &= ~DIP_IMAGE_FILTER_AUTO;
+
+	// the reductions by 4 times and more are halved by the exact 2x2 averaging first (as the mipmaps are),
+	// the largest power of 2 that leaves at least twice the target size to the filter
+	int factor = min(source_width / (width * 2), source_height / (height * 2));
+	if (prescale && filter != DIP_IMAGE_FILTER_BOX && factor >= 2) {
+		FIT *reduced = halve(source);
+		for (int level = 4; reduced && level <= factor; level *= 2) {
+			FIT *next = halve(reduced);
+			FreeImage_Unload(reduced);
+			reduced = next;
+		}
+		if (reduced) {
+			bool result = render(reduced, destination, x, y, width, height, filter, compositor);
+			FreeImage_Unload(reduced);
+			return result;
+		}
+	}
+
+	DIP::Resampler resampler(source_width, source_height, width, height, channels, filter);
+	if (resampler.isValid() == false) {
+		return false;
+	}
+
+	size_t pitch = FreeImage_GetPitch(destination);
+	BYTE *bits = FreeImage_GetBits(destination) + (destination_height - height - y) * pitch + x * destination_channels;
+
+	DIP::Resampler::RowReader reader = rows.reader();
+	size_t pixels = static_cast<size_t>(source_width) * source_height;
+
+	// the bands are resampled independently, the rows are the same as the ones of the whole image
+	if (channels == destination_channels && compositor.isBlending() == false) {
+		parallelRows(pixels, height, [&] (int first, int last) {
+			resampler.resample(reader, bits, pitch, first, last);
+		});
+		return true;
+	}
+
+	// the rows go bottom-up, the checkerboard starts at the top
+	DIP::Resampler::RowWriter writer = [&] (const unsigned char *row, int line) {
+		compositor.convert(row, channels, bits + line * pitch, destination_channels, width, 0, height - 1 - line);
+	};
+	parallelRows(pixels, height, [&] (int first, int last) {
+		resampler.resample(reader, writer, first, last);
+	});
+	return true;
+}
+
+static FIT *rescale(FIT *source, int width, int height, int filter)
+{
+	int channels = RowSource(source).channels();
+	if (channels == 0) {
+		return FreeImage_Rescale(source, width, height, static_cast<FREE_IMAGE_FILTER>(filter & ~DIP_IMAGE_FILTER_AUTO));
+	}
+
+	// the grayscale palette is set by default, the palette images are expanded
+	FIT *result = FreeImage_Allocate(width, height, channels * 8);
+	if (result == nullptr) {
+		return nullptr;
+	}
+
+	if (render(source, result, 0, 0, width, height, filter, DIP::Compositor()) == false) {
+		FreeImage_Unload(result);
+		return nullptr;
+	}
+	return result;
+}
+
+// averages each 2x2 block of the 8-bit gray and RGB(A) images, the other ones are reduced by the box filter
+static FIT *halve(FIT *source)
+{
+	int width = FreeImage_GetWidth(source) / 2;
+	int height = FreeImage_GetHeight(source) / 2;
+	unsigned int bpp = FreeImage_GetBPP(source);
+
+	if (resamplerChannels(source) == 0) {
+		return rescale(source, width, height, DIP_IMAGE_FILTER_BOX);
+	}
+
+	FIT *result = FreeImage_Allocate(width, height, bpp);
+	if (result == nullptr) {
+		return nullptr;
+	}
+
+	int bytes = bpp / 8;
+	for (int y = 0; y < height; ++y) {
+		const BYTE *top = FreeImage_GetScanLine(source, y * 2);
+		const BYTE *bottom = FreeImage_GetScanLine(source, y * 2 + 1);
+		BYTE *line = FreeImage_GetScanLine(result, y);
+		for (int x = 0; x < width * bytes; x += bytes) {
+			for (int c = 0; c < bytes; ++c) {
+				line[x + c] = static_cast<BYTE>((top[x * 2 + c] + top[x * 2 + bytes + c] + bottom[x * 2 + c] + bottom[x * 2 + bytes + c] + 2) >> 2);
+			}
+		}
+	}
+
+	return result;
+}
+
+void DIP::Image::buildMipmaps()
+{
+	int state = 0;
+	if (m_data == nullptr || m_mipmaps_state.compare_exchange_strong(state, 1) == false) {
+		return;
+	}
+
+	std::vector<DIP::Image *> mipmaps;
+	const DIP::Image *level = this;
+	while (level->m_width / 2 >= DIP_IMAGE_MIPMAP_LIMIT && level->m_height / 2 >= DIP_IMAGE_MIPMAP_LIMIT) {
+		FIT *data = halve(FIDF(level->m_data));
+		if (data == nullptr) {
+			break;
+		}
+
+		DIP::Image *mipmap = new DIP::Image();
+		mipmap->m_data = data;
+		mipmap->updateMetrics();
+		mipmap->m_source_width = m_source_width;
+		mipmap->m_source_height = m_source_height;
+		mipmaps.push_back(mipmap);
+
+		level = mipmap;
+	}
+
+	m_mipmaps = std::move(mipmaps);
+	m_mipmaps_state = 2;
+}
+
+const DIP::Image &DIP::Image::mipmap(int width, int height) const
+{
+	const DIP::Image *level = this;
+	if (m_mipmaps_state != 2) {
+		return *level;
+	}
+	for (const DIP::Image *mipmap : m_mipmaps) {
+		if (mipmap->m_width < width || mipmap->m_height < height) {
+			break;
+		}
+		level = mipmap;
+	}
+	return *level;
+}
+
 bool DIP::Image::isInitialized() const
 {
 	return m_data;
@@ -87,9 +1305,181 @@ unsigned int DIP::Image::bpp() const
 	return FreeImage_GetBPP(FID);
 }
 
+int DIP::Image::channels() const
+{
+	return m_data ? resamplerChannels(FID) : 0;
+}
+
+const unsigned char *DIP::Image::row(int line) const
+{
+	return FreeImage_GetScanLine(FID, line);
+}
+
+size_t DIP::Image::memorySize() const
+{
+	size_t size = m_data ? static_cast<size_t>(FreeImage_GetPitch(FID)) * FreeImage_GetHeight(FID) : 0;
+	if (m_mipmaps_state != 2) {
+		return size;
+	}
+	for (const DIP::Image *mipmap : m_mipmaps) {
+		size += mipmap->memorySize();
+	}
+	return size;
+}
+
+int DIP::Image::sourceWidth() const
+{
+	return m_source_width;
+}
+
+int DIP::Image::sourceHeight() const
+{
+	return m_source_height;
+}
+
+void DIP::Image::setSourceSize(int width, int height)
+{
+	m_source_width = width;
+	m_source_height = height;
+}
+
+int DIP::Image::orientation() const
+{
+	return m_orientation;
+}
+
+bool DIP::Image::isTransposed() const
+{
+	return m_orientation >= 5;
+}
+
+int DIP::Image::orientedWidth() const
+{
+	return this->isTransposed() ? m_height : m_width;
+}
+
+int DIP::Image::orientedHeight() const
+{
+	return this->isTransposed() ? m_width : m_height;
+}
+
+bool DIP::Image::isReduced() const
+{
+	return m_width < m_source_width || m_height < m_source_height;
+}
+
+bool DIP::Image::covers(int width, int height) const
+{
+	if (this->isReduced() == false) {
+		// there is nothing better than the original
+		return true;
+	}
+	std::pair<int, int> size = this->inscribe(width, height);
+	return size.first <= this->orientedWidth() && size.second <= this->orientedHeight();
+}
+
 bool DIP::Image::hasAlpha() const
 {
-	return FreeImage_IsTransparent(FID);
+	return m_opaque == false;
+}
+
+bool DIP::Image::isOpaque() const
+{
+	return m_opaque;
+}
+
+bool DIP::Image::scanOpacity() const
+{
+	if (m_data == nullptr) {
+		return true;
+	}
+
+	// FreeImage_IsTransparent() would scan the alpha of the 32-bit image pixel by pixel, so it is left for the others
+	if (resamplerChannels(FID) == 4) {
+		for (int line = 0; line < m_height; ++line) {
+			if (DIP::Compositor::isOpaque(FreeImage_GetScanLine(FID, line), m_width) == false) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	if (FreeImage_IsTransparent(FID) == false) {
+		return true;
+	}
+
+	// the palettes with the transparency table, the unused entries are checked too
+	if (FreeImage_GetBPP(FID) <= 8 && FreeImage_GetImageType(FID) == FIT_BITMAP) {
+		const BYTE *table = FreeImage_GetTransparencyTable(FID);
+		unsigned int count = FreeImage_GetTransparencyCount(FID);
+		for (unsigned int i = 0; i < count; ++i) {
+			if (table[i] != 255) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
+
+DIP::ImageInfo DIP::Image::info() const
+{
+	DIP::ImageInfo info;
+	info.width = this->isTransposed() ? m_source_height : m_source_width;
+	info.height = this->isTransposed() ? m_source_width : m_source_height;
+	info.bpp = this->bpp();
+	info.alpha = this->hasAlpha();
+	return info;
+}
+
+std::string DIP::Image::text(const char *key) const
+{
+	FITAG *tag = nullptr;
+	if (m_data == nullptr || FreeImage_GetMetadata(FIMD_COMMENTS, FID, key, &tag) == false || tag == nullptr || FreeImage_GetTagType(tag) != FIDT_ASCII) {
+		return std::string();
+	}
+	return static_cast<const char *>(FreeImage_GetTagValue(tag));
+}
+
+void DIP::Image::setText(const char *key, const std::string &value)
+{
+	if (m_data) {
+		FreeImage_SetMetadataKeyValue(FIMD_COMMENTS, FID, key, value.data());
+	}
+}
+
+bool DIP::Image::save(const wchar_t *filename) const
+{
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilenameU(filename);
+	if (m_data == nullptr || fif == FIF_UNKNOWN || FreeImage_FIFSupportsWriting(fif) == false) {
+		return false;
+	}
+	return FreeImage_SaveU(fif, FID, filename, 0);
+}
+
+bool DIP::Image::probe(const wchar_t *filename, DIP::ImageInfo &info)
+{
+	Source source(filename);
+	FREE_IMAGE_FORMAT fif = source.format();
+	// the formats without header-only loading would be fully decoded here
+	if (fif == FIF_UNKNOWN || FreeImage_FIFSupportsReading(fif) == false || FreeImage_FIFSupportsNoPixels(fif) == false) {
+		return false;
+	}
+
+	FIT *header = source.load(fif, FIF_LOAD_NOPIXELS);
+	if (header == nullptr) {
+		return false;
+	}
+
+	bool transposed = readOrientation(header, fif) >= 5;
+	info.width = transposed ? FreeImage_GetHeight(header) : FreeImage_GetWidth(header);
+	info.height = transposed ? FreeImage_GetWidth(header) : FreeImage_GetHeight(header);
+	info.bpp = FreeImage_GetBPP(header);
+	info.alpha = FreeImage_IsTransparent(header);
+
+	FreeImage_Unload(header);
+	return info.width > 0 && info.height > 0;
 }
 
 HBITMAP DIP::Image::bitmap() const
@@ -110,63 +1500,215 @@ void DIP::Image::draw(const DIP::Image &destination, int x, int y) const
 	FreeImage_Paste(FIDF(destination.m_data), FID, x, y, 255);
 }
 
-void DIP::Image::draw(const DIP::Image &destination, int x, int y, int width, int height, int filter) const
+void DIP::Image::draw(const DIP::Image &destination, int x, int y, int width, int height, int filter, const DIP::Compositor &compositor) const
 {
-	if (width == m_width && height == m_height) {
-		FreeImage_Paste(FIDF(destination.m_data), FID, x, y, 255);
+	const DIP::Image &source = this->mipmap(width, height);
+	// the opaque pixels are copied as they are
+	const DIP::Compositor &converter = m_opaque ? DIP::Compositor() : compositor;
+	if (m_orientation == 1 && render(FIDF(source.m_data), FIDF(destination.m_data), x, y, width, height, filter, converter)) {
 		return;
 	}
-	FIBITMAP *scaled = FreeImage_Rescale(FID, width, height, static_cast<FREE_IMAGE_FILTER>(filter));
-	FreeImage_Paste(FIDF(destination.m_data), scaled, x, y, 255);
-	FreeImage_Unload(scaled);
+
+	// the turned ones are scaled aside, the same size box filter copies the pixels in the destination format
+	DIP::Image *scaled = this->scaled(width, height, filter, converter);
+	if (scaled->m_data && render(FIDF(scaled->m_data), FIDF(destination.m_data), x, y, width, height, DIP_IMAGE_FILTER_BOX, DIP::Compositor()) == false) {
+		FreeImage_Paste(FIDF(destination.m_data), FIDF(scaled->m_data), x, y, 255);
+	}
+	delete scaled;
+}
+
+DIP::Image *DIP::Image::scaled(int width, int height, int filter, const DIP::Compositor &compositor) const
+{
+	if (m_orientation == 1) {
+		return this->resized(width, height, filter, compositor);
+	}
+
+	// the pixels are scaled as they are decoded, only the small result is turned
+	bool transposed = this->isTransposed();
+	DIP::Image *image = this->resized(transposed ? height : width, transposed ? width : height, filter, compositor);
+	image->orient(m_orientation);
+	return image;
 }
 
-DIP::Image *DIP::Image::scaled(int width, int height, int filter) const
+void DIP::Image::orient(int orientation)
+{
+	// the angle (counterclockwise) and the flips of the EXIF orientations 1 - 8
+	static const int angles[] = {0, 0, 180, 0, -90, -90, -90, 90};
+	static const bool horizontal[] = {false, true, false, false, true, false, false, false};
+	static const bool vertical[] = {false, false, false, true, false, false, true, false};
+
+	if (m_data == nullptr || orientation < 2 || orientation > 8) {
+		return;
+	}
+
+	int index = orientation - 1;
+	if (angles[index]) {
+		FIT *rotated = FreeImage_Rotate(FID, angles[index]);
+		if (rotated == nullptr) {
+			return;
+		}
+		FreeImage_Unload(FID);
+		m_data = rotated;
+	}
+	if (horizontal[index]) {
+		FreeImage_FlipHorizontal(FID);
+	}
+	if (vertical[index]) {
+		FreeImage_FlipVertical(FID);
+	}
+
+	m_width = FreeImage_GetWidth(FID);
+	m_height = FreeImage_GetHeight(FID);
+	if (orientation >= 5) {
+		std::swap(m_source_width, m_source_height);
+	}
+	m_orientation = 1;
+}
+
+DIP::Image *DIP::Image::resized(int width, int height, int filter, const DIP::Compositor &compositor) const
 {
 	DIP::Image *image = new DIP::Image();
 	image->m_width = width;
 	image->m_height = height;
-	image->m_data = FreeImage_Rescale(FID, width, height, static_cast<FREE_IMAGE_FILTER>(filter));
+	image->m_source_width = m_source_width;
+	image->m_source_height = m_source_height;
+
+	const DIP::Image &source = this->mipmap(width, height);
+	bool blending = compositor.isBlending() && m_opaque == false;
+	image->m_opaque = m_opaque || blending;
+
+	int channels = RowSource(FIDF(source.m_data)).channels();
+	if (channels) {
+		// the composited image has no alpha, as the FreeImage_Composite one, the opaque one drops it as well,
+		// the palette images are expanded only here, at the final size
+		unsigned int bpp = blending || (m_opaque && channels == 4) ? 24 : channels * 8;
+		image->m_data = FreeImage_Allocate(width, height, bpp);
+		if (image->m_data && render(FIDF(source.m_data), FIDF(image->m_data), 0, 0, width, height, filter, blending ? compositor : DIP::Compositor())) {
+			return image;
+		}
+		FreeImage_Unload(FIDF(image->m_data));
+	}
+
+	image->m_data = FreeImage_Rescale(FIDF(source.m_data), width, height, static_cast<FREE_IMAGE_FILTER>(filter & ~DIP_IMAGE_FILTER_AUTO));
+	if (blending && image->m_data && FreeImage_GetBPP(FIDF(image->m_data)) != 32) {
+		// the transparent palettes and the like are blended as 32-bit
+		FIT *converted = FreeImage_ConvertTo32Bits(FIDF(image->m_data));
+		FreeImage_Unload(FIDF(image->m_data));
+		image->m_data = converted;
+	}
+	if (blending && image->m_data) {
+		image->composite(compositor);
+	}
 	return image;
 }
 
-DIP::Image *DIP::Image::inscribed(int width, int height, int filter) const
+DIP::Image *DIP::Image::inscribed(int width, int height, int filter, const DIP::Compositor &compositor) const
 {
 	std::pair<int, int> size = this->inscribe(width, height);
-	return this->scaled(size.first, size.second, filter);
+	return this->scaled(size.first, size.second, filter, compositor);
 }
 
-DIP::Image *DIP::Image::composited(bool checkerboard) const
+bool DIP::Image::composite(const DIP::Compositor &compositor)
+{
+	if (m_opaque) {
+		return true;
+	}
+	if (resamplerChannels(FID) != 4) {
+		return false;
+	}
+
+	// the rows go bottom-up, the checkerboard starts at the top
+	for (int line = 0; line < m_height; ++line) {
+		compositor.composite(FreeImage_GetScanLine(FID, line), m_width, 0, m_height - 1 - line);
+	}
+
+	if (compositor.isBlending()) {
+		FreeImage_SetTransparent(FID, FALSE);
+		m_opaque = true;
+	}
+	return true;
+}
+
+DIP::Image *DIP::Image::composited(const DIP::Compositor &compositor) const
 {
 	DIP::Image *image = new DIP::Image();
 	image->m_width = m_width;
 	image->m_height = m_height;
-	image->m_data = FreeImage_Composite(FID, !checkerboard);
+	image->m_source_width = m_source_width;
+	image->m_source_height = m_source_height;
+	image->m_orientation = m_orientation;
+	// the clone is transparent as the original is, so composite() does not take it for an opaque one
+	image->m_opaque = m_opaque;
+	image->m_data = FreeImage_Clone(FID);
+
+	if (image->m_data && image->composite(compositor) == false) {
+		FreeImage_Unload(FIDF(image->m_data));
+		RGBQUAD color;
+		color.rgbBlue = compositor.color()[0];
+		color.rgbGreen = compositor.color()[1];
+		color.rgbRed = compositor.color()[2];
+		color.rgbReserved = 0;
+		image->m_data = FreeImage_Composite(FID, FALSE, compositor.mode() == DIP::Compositor::MODE_COLOR ? &color : nullptr);
+		image->m_opaque = true;
+	}
 	return image;
 }
 
-DIP::Image *DIP::Image::composited(BYTE red, BYTE green, BYTE blue) const
+DIP::Image *DIP::Image::composited(bool checkerboard) const
 {
+	if (checkerboard) {
+		return this->composited(DIP::Compositor(DIP::Compositor::MODE_CHECKERBOARD));
+	}
+
+	// the background color of the file
 	DIP::Image *image = new DIP::Image();
 	image->m_width = m_width;
 	image->m_height = m_height;
-
-	RGBQUAD color;
-	color.rgbRed = red;
-	color.rgbGreen = green;
-	color.rgbBlue = blue;
-	color.rgbReserved = 0;
-
-	image->m_data = FreeImage_Composite(FID, false, &color);
+	image->m_source_width = m_source_width;
+	image->m_source_height = m_source_height;
+	image->m_orientation = m_orientation;
+	image->m_data = FreeImage_Composite(FID, TRUE);
+	image->m_opaque = true;
 	return image;
 }
 
+DIP::Image *DIP::Image::composited(BYTE red, BYTE green, BYTE blue) const
+{
+	return this->composited(DIP::Compositor(DIP::Compositor::MODE_COLOR, red, green, blue));
+}
+
 DIP::Image *DIP::Image::composited(const DIP::Image &background) const
 {
 	DIP::Image *image = new DIP::Image();
 	image->m_width = m_width;
 	image->m_height = m_height;
+	image->m_source_width = m_source_width;
+	image->m_source_height = m_source_height;
+	image->m_orientation = m_orientation;
 	image->m_data = FreeImage_Composite(FID, false, nullptr, FIDF(background.m_data));
+	image->m_opaque = true;
+	return image;
+}
+
+DIP::Image *DIP::Image::region(int x, int y, int width, int height) const
+{
+	if (m_data == nullptr || x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > m_width || y + height > m_height) {
+		return nullptr;
+	}
+
+	FIT *data = FreeImage_Copy(FID, x, y, x + width, y + height);
+	if (data && FreeImage_GetBPP(data) == 32) {
+		FIT *converted = FreeImage_ConvertTo24Bits(data);
+		FreeImage_Unload(data);
+		data = converted;
+	}
+	if (data == nullptr) {
+		return nullptr;
+	}
+
+	DIP::Image *image = new DIP::Image();
+	image->m_data = data;
+	image->updateMetrics();
 	return image;
 }
 
@@ -177,17 +1719,24 @@ std::wstring DIP::Image::version()
 	buffer += FreeImage_GetVersion();
 	buffer += "\n\n";
 	buffer += FreeImage_GetCopyrightMessage();
+	buffer += "\n\nResampler: ";
+	buffer += DIP::Resampler::instructionSet();
 	return std::wstring(buffer.begin(), buffer.end());
 }
 
 std::pair<int, int> DIP::Image::inscribe(int width, int height) const
 {
-	float ratio = (static_cast<float>(m_width) / m_height) / (static_cast<float>(width) / height);
+	return inscribe(this->orientedWidth(), this->orientedHeight(), width, height);
+}
+
+std::pair<int, int> DIP::Image::inscribe(int source_width, int source_height, int width, int height)
+{
+	float ratio = (static_cast<float>(source_width) / source_height) / (static_cast<float>(width) / height);
 
 	if (ratio > 1) {
-		return {width, static_cast<int>(static_cast<float>(width) / m_width * m_height)};
+		return {width, static_cast<int>(static_cast<float>(width) / source_width * source_height)};
 	}	else if (ratio < 1) {
-		return {static_cast<int>(static_cast<float>(height) / m_height * m_width), height};
+		return {static_cast<int>(static_cast<float>(height) / source_height * source_width), height};
 	}
 
 	return {width, height};
@@ -1,8 +1,13 @@
 #ifndef DIP_IMAGE_H
 #define DIP_IMAGE_H
 
+#include "Compositor.h"
+
 #include <Windows.h>
+#include <atomic>
+#include <functional>
 #include <string>
+#include <vector>
 
 #define DIP_IMAGE_FILTER_BOX        0
 #define DIP_IMAGE_FILTER_BICUBIC    1
@@ -10,9 +15,30 @@
 #define DIP_IMAGE_FILTER_BSPLINE    3
 #define DIP_IMAGE_FILTER_CATMULLROM 4
 #define DIP_IMAGE_FILTER_LANCZOS3   5
+// the flag of the filter: large reductions are done by an integer box pre-pass, the filter is applied to the result
+#define DIP_IMAGE_FILTER_AUTO       0x100
+
+// RAW files are decoded at half size when the required size does not exceed this limit
+#define DIP_IMAGE_RAW_HALFSIZE_LIMIT 1000
+// embedded thumbnails are looked up only for boxes not larger than this limit
+#define DIP_IMAGE_EMBEDDED_THUMBNAIL_LIMIT 320
+// the mipmap chain ends before a level with a side shorter than this limit
+#define DIP_IMAGE_MIPMAP_LIMIT 16
+// the scaling is split into the bands of rows run on the thread pool, each band takes at least
+// this number of the source pixels and of the destination rows
+#define DIP_IMAGE_BAND_PIXELS (4 * 1024 * 1024)
+#define DIP_IMAGE_BAND_ROWS 16
 
 namespace DIP {
 
+	// the image metadata that is available without decoding the pixels
+	struct ImageInfo {
+		int width = 0;
+		int height = 0;
+		unsigned int bpp = 0;
+		bool alpha = false;
+	};
+
 	// the wrapper class for a image-processing library
 	class Image
 	{
@@ -20,7 +46,14 @@ namespace DIP {
 		Image();
 		Image(int width, int height, BYTE red = 0, BYTE green = 0, BYTE blue = 0);
 		Image(int width, int height, const RGBQUAD &color);
+		// copies the packed rows of the 8-bit pixels (gray, BGR, BGRA), the rows go bottom-up
+		Image(int width, int height, int channels, const unsigned char *pixels);
+		// the rows are written by the filler one by one (bottom-up) straight into the bitmap, the image stays uninitialized if it fails
+		Image(int width, int height, int channels, const std::function<bool (int line, unsigned char *row)> &fill);
 		Image(const wchar_t *filename);
+		// decodes at the smallest resolution that still covers the given box (if the format allows it),
+		// the decoding stops as soon as the cancelled flag is set
+		Image(const wchar_t *filename, int width, int height, const std::atomic<bool> *cancelled = nullptr);
 		~Image();
 
 		bool isInitialized() const;
@@ -28,31 +61,98 @@ namespace DIP {
 		int width() const;
 		int height() const;
 		unsigned int bpp() const;
-
+		// the number of the 8-bit channels (gray, BGR, BGRA), 0 for the other formats
+		int channels() const;
+		// the row of the pixels, the rows go bottom-up
+		const unsigned char *row(int line) const;
+
+		// dimensions of the original image, they differ from width() and height() for reduced decoding
+		int sourceWidth() const;
+		int sourceHeight() const;
+		// the image is a thumbnail of the larger one (read from a cache), so it gets reloaded when it does not cover the size
+		void setSourceSize(int width, int height);
+
+		// the EXIF orientation (1 - 8), the pixels are kept as decoded, the scaled images are turned
+		int orientation() const;
+		// the orientations 5 - 8 swap the width and the height
+		bool isTransposed() const;
+		int orientedWidth() const;
+		int orientedHeight() const;
+
+		bool isReduced() const;
+		bool covers(int width, int height) const;
+
+		// some pixel is transparent, the same flag as isOpaque() (the alpha is not scanned again)
 		bool hasAlpha() const;
+		// no pixel is transparent, so the image needs no compositing, checked once when the pixels are set
+		bool isOpaque() const;
+
+		// the size of the pixel data in bytes, including the mipmaps
+		size_t memorySize() const;
+
+		// builds the chain of the images reduced by 2, 4, 8... with the box filter, the scaling starts
+		// from the smallest of them that still covers the requested size; the shared image may be scaled
+		// by the other threads meanwhile, they use the chain only once it is complete
+		void buildMipmaps();
+		const DIP::Image &mipmap(int width, int height) const;
+
+		DIP::ImageInfo info() const;
 
 		HBITMAP bitmap() const;
 		void draw(HDC hdc, int x, int y) const;
 		void draw(const DIP::Image &destination, int x, int y) const;
-		void draw(const DIP::Image &destination, int x, int y, int width, int height, int filter = DIP_IMAGE_FILTER_BOX) const;
+		// scales the image straight into the rectangle of the destination, the pixels are converted by the compositor on the way
+		void draw(const DIP::Image &destination, int x, int y, int width, int height, int filter = DIP_IMAGE_FILTER_BOX, const DIP::Compositor &compositor = DIP::Compositor()) const;
 
 		std::pair<int, int> inscribe(int width, int height) const;
+		static std::pair<int, int> inscribe(int source_width, int source_height, int width, int height);
+
+		// the size is the oriented one, the blending compositor gives the image without alpha
+		DIP::Image *scaled(int width, int height, int filter = DIP_IMAGE_FILTER_BOX, const DIP::Compositor &compositor = DIP::Compositor()) const;
+		DIP::Image *inscribed(int width, int height, int filter = DIP_IMAGE_FILTER_BOX, const DIP::Compositor &compositor = DIP::Compositor()) const;
 
-		DIP::Image *scaled(int width, int height, int filter = DIP_IMAGE_FILTER_BOX) const;
-		DIP::Image *inscribed(int width, int height, int filter = DIP_IMAGE_FILTER_BOX) const;
+		// blends the 32-bit image in place (the opaque one is left as is), returns false for the other formats
+		bool composite(const DIP::Compositor &compositor);
 
+		DIP::Image *composited(const DIP::Compositor &compositor) const;
 		DIP::Image *composited(bool checkerboard = true) const;
 		DIP::Image *composited(BYTE red, BYTE green, BYTE blue) const;
 		DIP::Image *composited(const DIP::Image &background) const;
 
+		// the copy of the rectangle (the top-left origin) without the alpha channel, so a part of a canvas
+		// becomes an opaque image, nullptr if the rectangle is out of the image
+		DIP::Image *region(int x, int y, int width, int height) const;
+
+		// the text fields (the comments, the PNG text chunks), empty if the field is missing
+		std::string text(const char *key) const;
+		void setText(const char *key, const std::string &value);
+
+		// the format is chosen by the extension of the filename
+		bool save(const wchar_t *filename) const;
+
+		// reads the image header only, returns false if the format cannot be probed without decoding
+		static bool probe(const wchar_t *filename, DIP::ImageInfo &info);
+
 		static std::wstring version();
 
 	private:
+		void load(const wchar_t *filename, int width = 0, int height = 0, const std::atomic<bool> *cancelled = nullptr);
 		void updateMetrics();
+		DIP::Image *resized(int width, int height, int filter, const DIP::Compositor &compositor) const;
+		void orient(int orientation);
+		bool scanOpacity() const;
 
 		void *m_data;
 		int m_width;
 		int m_height;
+		int m_source_width;
+		int m_source_height;
+		bool m_opaque;
+		int m_orientation = 1;
+
+		std::vector<DIP::Image *> m_mipmaps;
+		// the chain is not built yet (0), is being built (1), is complete (2)
+		std::atomic<int> m_mipmaps_state {0};
 	};
 
 } // namespace DIP
@@ -0,0 +1,62 @@
+#include "ImageCache.h"
+
+DIP::ImageCache::ImageCache(size_t budget) : m_budget(budget)
+{
+}
+
+size_t DIP::ImageCache::budget() const
+{
+	return m_budget;
+}
+
+size_t DIP::ImageCache::used() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_used;
+}
+
+std::shared_ptr<DIP::Image> DIP::ImageCache::find(const std::wstring &key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_index.find(key);
+	if (it == m_index.end()) {
+		return nullptr;
+	}
+	m_list.splice(m_list.begin(), m_list, it->second);
+	return it->second->second;
+}
+
+void DIP::ImageCache::insert(const std::wstring &key, const std::shared_ptr<DIP::Image> &image)
+{
+	size_t size = image ? image->memorySize() : 0;
+	if (image == nullptr || size > m_budget) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_index.find(key);
+	if (it != m_index.end()) {
+		m_used -= it->second->second->memorySize();
+		m_list.erase(it->second);
+		m_index.erase(it);
+	}
+
+	m_list.emplace_front(key, image);
+	m_index[key] = m_list.begin();
+	m_used += size;
+
+	while (m_used > m_budget) {
+		m_used -= m_list.back().second->memorySize();
+		m_index.erase(m_list.back().first);
+		m_list.pop_back();
+	}
+}
+
+void DIP::ImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_list.clear();
+	m_index.clear();
+	m_used = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef DIP_IMAGECACHE_H
+#define DIP_IMAGECACHE_H
+
+#include "Image.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace DIP {
+
+	// the images kept in memory under the string keys, the least recently used ones are dropped
+	// when the total size of their pixels exceeds the budget
+	class ImageCache
+	{
+	public:
+		// the budget is in bytes
+		ImageCache(size_t budget);
+
+		ImageCache(const ImageCache&) = delete;
+		ImageCache& operator=(const ImageCache&) = delete;
+
+		size_t budget() const;
+		size_t used() const;
+
+		// returns nullptr if there is no image for the key
+		std::shared_ptr<DIP::Image> find(const std::wstring &key);
+		// the image larger than the whole budget is not kept
+		void insert(const std::wstring &key, const std::shared_ptr<DIP::Image> &image);
+		void clear();
+
+	private:
+		typedef std::list<std::pair<std::wstring, std::shared_ptr<DIP::Image>>> List;
+
+		// the most recently used first
+		List m_list;
+		std::unordered_map<std::wstring, List::iterator> m_index;
+
+		size_t m_budget;
+		size_t m_used = 0;
+
+		mutable std::mutex m_mutex;
+	};
+
+} // namespace DIP
+
+#endif // DIP_IMAGECACHE_H
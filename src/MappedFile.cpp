@@ -0,0 +1,275 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <string>
+#endif
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+DIP::MappedFile::MappedFile(const wchar_t *filename, Mode mode, uint64_t limit)
+{
+	if (this->map(filename, limit) == false && mode == MODE_MAP_OR_READ) {
+		this->read(filename, limit);
+	}
+}
+
+DIP::MappedFile::~MappedFile()
+{
+	this->unmap();
+}
+
+bool DIP::MappedFile::isValid() const
+{
+	return m_data != nullptr;
+}
+
+bool DIP::MappedFile::isMapped() const
+{
+	return m_mapped;
+}
+
+const unsigned char *DIP::MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t DIP::MappedFile::size() const
+{
+	return m_size;
+}
+
+#ifdef _WIN32
+
+bool DIP::MappedFile::map(const wchar_t *filename, uint64_t limit)
+{
+	m_file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	// an empty file cannot be mapped, and a huge one will not fit into the address space of the x32 build
+	if (GetFileSizeEx(m_file, &size) == false || size.QuadPart <= 0 || static_cast<uint64_t>(size.QuadPart) > SIZE_MAX || static_cast<uint64_t>(size.QuadPart) > limit) {
+		this->unmap();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr) {
+		this->unmap();
+		return false;
+	}
+
+	m_data = static_cast<const unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		this->unmap();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_mapped = true;
+	return true;
+}
+
+void DIP::MappedFile::unmap()
+{
+	if (m_mapped && m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
+static FILE *openFile(const wchar_t *filename)
+{
+	FILE *file = nullptr;
+	return _wfopen_s(&file, filename, L"rb") == 0 ? file : nullptr;
+}
+
+// -1 if the size is not known
+static long long fileSize(FILE *file)
+{
+	return _filelengthi64(_fileno(file));
+}
+
+// the pages of the mapped files on the network or removable drives may fail to be read in,
+// which raises EXCEPTION_IN_PAGE_ERROR on the access instead of an error of a read
+#ifdef _MSC_VER
+static bool copyMapped(void *buffer, const unsigned char *data, size_t size)
+{
+	__try {
+		memcpy(buffer, data, size);
+	} __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+		return false;
+	}
+	return true;
+}
+#else
+// GCC has no __try, IsBadReadPtr touches every page of the range under its own handler,
+// so the pages are either read in before the copying or reported as unreadable
+static bool copyMapped(void *buffer, const unsigned char *data, size_t size)
+{
+	if (size > 0 && IsBadReadPtr(data, size)) {
+		return false;
+	}
+	memcpy(buffer, data, size);
+	return true;
+}
+#endif
+
+#else
+
+static std::string narrowFilename(const wchar_t *filename)
+{
+	std::string result;
+	size_t length = wcstombs(nullptr, filename, 0);
+	if (length == static_cast<size_t>(-1)) {
+		return result;
+	}
+	result.resize(length);
+	wcstombs(&result[0], filename, length);
+	return result;
+}
+
+bool DIP::MappedFile::map(const wchar_t *filename, uint64_t limit)
+{
+	std::string path = narrowFilename(filename);
+	if (path.empty()) {
+		return false;
+	}
+
+	int descriptor = open(path.data(), O_RDONLY);
+	if (descriptor == -1) {
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size <= 0 || static_cast<uint64_t>(status.st_size) > SIZE_MAX || static_cast<uint64_t>(status.st_size) > limit) {
+		close(descriptor);
+		return false;
+	}
+
+	void *data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// the mapping stays valid after the descriptor is closed
+	close(descriptor);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	madvise(data, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+
+	m_data = static_cast<const unsigned char *>(data);
+	m_size = static_cast<size_t>(status.st_size);
+	m_mapped = true;
+	return true;
+}
+
+void DIP::MappedFile::unmap()
+{
+	if (m_mapped && m_data) {
+		munmap(const_cast<unsigned char *>(m_data), m_size);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
+static FILE *openFile(const wchar_t *filename)
+{
+	std::string path = narrowFilename(filename);
+	return path.empty() ? nullptr : fopen(path.data(), "rb");
+}
+
+// -1 if the size is not known
+static long long fileSize(FILE *file)
+{
+	struct stat status;
+	return fstat(fileno(file), &status) == 0 && S_ISREG(status.st_mode) ? static_cast<long long>(status.st_size) : -1;
+}
+
+static bool copyMapped(void *buffer, const unsigned char *data, size_t size)
+{
+	memcpy(buffer, data, size);
+	return true;
+}
+
+#endif
+
+bool DIP::MappedFile::read(const wchar_t *filename, uint64_t limit)
+{
+	FILE *file = openFile(filename);
+	if (file == nullptr) {
+		return false;
+	}
+
+	long long known = fileSize(file);
+	if (known >= 0 && (static_cast<uint64_t>(known) > limit || static_cast<uint64_t>(known) > SIZE_MAX)) {
+		fclose(file);
+		return false;
+	}
+
+	try {
+		if (known > 0) {
+			// allocated at once, the x32 address space gets no fragments of the growing buffer
+			m_buffer.resize(static_cast<size_t>(known));
+			m_buffer.resize(fread(m_buffer.data(), 1, m_buffer.size(), file));
+		} else {
+			// the size is not always known (pipes, some network filesystems), so the file is read in chunks
+			unsigned char chunk[64 * 1024];
+			size_t count;
+			while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+				if (m_buffer.size() + count > limit) {
+					m_buffer.clear();
+					break;
+				}
+				m_buffer.insert(m_buffer.end(), chunk, chunk + count);
+			}
+		}
+	} catch (const std::bad_alloc &) {
+		m_buffer.clear();
+	}
+	fclose(file);
+
+	if (m_buffer.empty()) {
+		m_buffer.shrink_to_fit();
+		return false;
+	}
+
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
+
+bool DIP::MappedFile::copy(void *buffer, size_t offset, size_t size) const
+{
+	if (m_data == nullptr || offset > m_size || size > m_size - offset) {
+		return false;
+	}
+	if (m_mapped == false) {
+		memcpy(buffer, m_data + offset, size);
+		return true;
+	}
+	return copyMapped(buffer, m_data + offset, size);
+}
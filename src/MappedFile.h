@@ -0,0 +1,57 @@
+#ifndef DIP_MAPPEDFILE_H
+#define DIP_MAPPEDFILE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace DIP {
+
+	// read-only view of a whole file: mapped into memory when possible, otherwise read into a buffer
+	class MappedFile
+	{
+	public:
+		enum Mode {
+			// the file that cannot be mapped is read into a buffer
+			MODE_MAP_OR_READ,
+			// the file that cannot be mapped is left invalid, the caller reads it on its own
+			MODE_MAP
+		};
+
+		// the files larger than the limit are neither mapped nor read
+		MappedFile(const wchar_t *filename, Mode mode = MODE_MAP_OR_READ, uint64_t limit = SIZE_MAX);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool isValid() const;
+		bool isMapped() const;
+
+		const unsigned char *data() const;
+		size_t size() const;
+
+		// copies the part of the data, false if it is out of the file or its pages cannot be read in
+		// (the mapped files on the network or removable drives), so the access does not crash the process
+		bool copy(void *buffer, size_t offset, size_t size) const;
+
+	private:
+		bool map(const wchar_t *filename, uint64_t limit);
+		bool read(const wchar_t *filename, uint64_t limit);
+		void unmap();
+
+		const unsigned char *m_data = nullptr;
+		size_t m_size = 0;
+		bool m_mapped = false;
+
+#ifdef _WIN32
+		void *m_file = nullptr;
+		void *m_mapping = nullptr;
+#endif
+
+		std::vector<unsigned char> m_buffer;
+	};
+
+} // namespace DIP
+
+#endif // DIP_MAPPEDFILE_H
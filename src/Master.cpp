@@ -251,7 +251,6 @@ LRESULT DIP::Master::ListerWindowProc(HWND hwnd, UINT message, WPARAM wParam, LP
 			GetClientRect(hwnd, &rect);
 			thumbs->resize(rect.right - rect.left, rect.bottom - rect.top);
 			if (thumbs->isUpdateRequired()) {
-				thumbs->update();
 				DIP::Master::instance().invalidate(hwnd);
 			}
 			break;
@@ -281,13 +280,14 @@ LRESULT DIP::Master::ListerWindowProc(HWND hwnd, UINT message, WPARAM wParam, LP
 			FillRect(hdc, &rect, brush);
 			DeleteObject(brush);
 
-			if (thumbs->isLoaded()) {
-				thumbs->draw(hdc, 0, 0);
-			} else {
+			if (thumbs->isLoaded() == false || thumbs->isUpdateRequired()) {
 				thumbs->update();
-				DIP::Master::instance().invalidate(hwnd);
+				// the rest of the thumbnails are painted as soon as they are ready
+				thumbs->wait(DIP::Master::instance().m_view_config.deadline);
 			}
 
+			thumbs->draw(hdc, 0, 0);
+
 			if (thumbs->infoShow()) {
 				GetClientRect(hwnd, &rect);
 
@@ -304,6 +304,23 @@ LRESULT DIP::Master::ListerWindowProc(HWND hwnd, UINT message, WPARAM wParam, LP
 		case WM_ERASEBKGND:
 			return 1;
 
+		case DIP_WM_THUMB_READY: {
+			DIP::Thumbs *thumbs = obtainThumbsFromHandle(hwnd);
+			if (thumbs == nullptr) {
+				return 0;
+			}
+
+			RECT rect;
+			if (thumbs->cellRect(static_cast<int>(wParam), rect)) {
+				InvalidateRect(hwnd, &rect, false);
+			}
+
+			// the tooltip gets the image info
+			DIP::Master &master = DIP::Master::instance();
+			master.processMouseMove(hwnd, master.mouse_x, master.mouse_y, master.m_tracking_mouse);
+			return 0;
+		}
+
 		case WM_COMMAND:
 			DIP::Master::instance().processCommand(hwnd, LOWORD(wParam));
 			return 0;
@@ -353,7 +370,7 @@ void DIP::Master::processDestroy(HWND hwnd)
 		this->processMouseLeave(hwnd);
 		DestroyWindow(m_tooltip);
 		m_tooltip = nullptr;
-		m_tooltip_image = nullptr;
+		m_tooltip_index = -1;
 	}
 }
 
@@ -530,15 +547,17 @@ void DIP::Master::processMouseMove(HWND hwnd, int x, int y, bool force)
 		m_tracking_mouse = true;
 	}
 
-	Image *image = thumbs->image(index);
-	if (image != m_tooltip_image) {
-		m_tooltip_image = image;
+	DIP::ImageInfo info;
+	bool known = thumbs->info(index, info);
+	if (index != m_tooltip_index || known != m_tooltip_known) {
+		m_tooltip_index = index;
+		m_tooltip_known = known;
 
 		std::wstring filename = thumbs->filenameAt(x, y);
 
 		WCHAR text[1024];
-		if (image) {
-			swprintf_s(text, ARRAYSIZE(text), L"%s\n#%d, %d x %d, %d BPP", filename.data(), index + 1, image->width(), image->height(), image->bpp());
+		if (known) {
+			swprintf_s(text, ARRAYSIZE(text), L"%s\n#%d, %d x %d, %d BPP", filename.data(), index + 1, info.width, info.height, info.bpp);
 		} else {
 			swprintf_s(text, ARRAYSIZE(text), L"%s\n#%d", filename.data(), index + 1);
 		}
@@ -555,7 +574,7 @@ void DIP::Master::processMouseMove(HWND hwnd, int x, int y, bool force)
 void DIP::Master::invalidate(HWND hwnd)
 {
 	InvalidateRect(hwnd, nullptr, false);
-	//m_tooltip_image = nullptr;
+	//m_tooltip_index = -1;
 	this->processMouseMove(hwnd, mouse_x, mouse_y, m_tracking_mouse);
 }
 
@@ -623,7 +642,7 @@ bool checkDots(const wchar_t *path)
 	return false;
 }
 
-DIP::Thumbs *DIP::Master::prepareThumbs(const wchar_t *path, int width, int height, const ShowConfig &config)
+DIP::Thumbs *DIP::Master::prepareThumbs(const wchar_t *path, int width, int height, const ShowConfig &config) const
 {
 	Log.debug(L"Generating thumbs | path = %s | size = %dx%d", path, width, height);
 
@@ -640,6 +659,7 @@ DIP::Thumbs *DIP::Master::prepareThumbs(const wchar_t *path, int width, int heig
 
 	thumbs->setBackground(config.background);
 	thumbs->setFilter(config.filter);
+	thumbs->setAutoFilter(config.auto_filter);
 	thumbs->setEnlarge(config.enlarge);
 	thumbs->setShowTransparencyGrid(config.transparency_grid);
 
@@ -651,6 +671,17 @@ DIP::Thumbs *DIP::Master::prepareThumbs(const wchar_t *path, int width, int heig
 	thumbs->setInfoSize(config.info_size);
 
 	thumbs->setShift(config.shift);
+	thumbs->setProbe(config.probe);
+	thumbs->setKeepImages(config.keep_images);
+
+	thumbs->setPrefetchDepth(config.prefetch);
+	thumbs->setPrefetchPrevious(config.prefetch_previous);
+	thumbs->setPrefetchMemory(static_cast<size_t>(config.prefetch_memory) * 1024 * 1024);
+	thumbs->setQuantize(config.quantize);
+
+	thumbs->setCache(m_cache);
+	thumbs->setMemoryCache(m_memory_cache);
+	thumbs->setSharedCache(m_shared_cache);
 
 	return thumbs;
 }
@@ -708,18 +739,41 @@ std::vector<std::wstring> DIP::Master::scan(const wchar_t *path, const ShowConfi
 
 HBITMAP DIP::Master::generateThumbs(const wchar_t *path, int width, int height) const
 {
-	DIP::Thumbs *thumbs = prepareThumbs(path, width, height, m_thumbs_config);
+	DIP::Thumbs *thumbs = this->prepareThumbs(path, width, height, m_thumbs_config);
 	if (thumbs == nullptr) {
 		return nullptr;
 	}
-	HBITMAP bitmap = thumbs->bitmap();
+
+	// the same folder with the same files is drawn from the preview made before
+	std::wstring key = thumbs->canvasKey();
+	std::shared_ptr<DIP::Image> canvas = m_previews ? m_previews->find(path + (L"|" + key)) : nullptr;
+	if (canvas == nullptr && m_cache) {
+		DIP::ImageInfo info;
+		canvas.reset(m_cache->load(path, key, info));
+		if (canvas && m_previews) {
+			m_previews->insert(path + (L"|" + key), canvas);
+		}
+	}
+
+	if (canvas) {
+		Log.debug(L"Thumbs have been taken from the cache | path = %s", path);
+	} else {
+		canvas.reset(thumbs->canvas());
+		if (m_previews) {
+			m_previews->insert(path + (L"|" + key), canvas);
+		}
+		if (m_cache) {
+			m_cache->store(path, key, *canvas, DIP::ImageInfo());
+		}
+	}
+
 	delete thumbs;
-	return bitmap;
+	return canvas->bitmap();
 }
 
 HWND DIP::Master::generateView(const wchar_t *path, HWND parent, int x, int y, int width, int height) const
 {
-	DIP::Thumbs *thumbs = prepareThumbs(path, width, height, m_view_config);
+	DIP::Thumbs *thumbs = this->prepareThumbs(path, width, height, m_view_config);
 	if (thumbs == nullptr) {
 		return nullptr;
 	}
@@ -746,6 +800,7 @@ HWND DIP::Master::generateView(const wchar_t *path, HWND parent, int x, int y, i
 	}
 
 	SetWindowLongPtr(handle, GWLP_USERDATA, reinterpret_cast<intptr_t>(thumbs));
+	thumbs->setNotifyWindow(handle);
 	return handle;
 }
 
@@ -754,6 +809,12 @@ static const std::unordered_map<const wchar_t *, unsigned int> languages_map = {
 	{L"ru", DIP::LANG_RU},
 };
 
+static const std::unordered_map<const wchar_t *, unsigned int> shared_thumbnails_map = {
+	{L"none",  DIP::SHARED_THUMBNAILS_NONE},
+	{L"read",  DIP::SHARED_THUMBNAILS_READ},
+	{L"write", DIP::SHARED_THUMBNAILS_WRITE}
+};
+
 static const std::unordered_map<const wchar_t *, unsigned int> log_levels_map = {
 	{L"",      DIP::Logger::LEVEL_NONE},
 	{L"none",  DIP::Logger::LEVEL_NONE},
@@ -767,6 +828,7 @@ void DIP::Master::loadConfig()
 	DIP::INI ini;
 	DIP::INI::Result result = ini.load(m_basepath + L"DirImage.ini");
 	if (result != DIP::INI::RESULT_OK) {
+		this->openCache();
 		return;
 	}
 
@@ -782,6 +844,14 @@ void DIP::Master::loadConfig()
 		Log.setOutputToStream(false);
 	}
 
+	ini.readBool(L"cache", m_cache_enabled);
+	ini.readString(L"cache_path", m_cache_path);
+	ini.readUInt(L"cache_size", m_cache_size);
+	ini.readUInt(L"memory_cache", m_memory_cache_size);
+	ini.readUInt(L"preview_memory", m_preview_memory);
+	ini.readEnum(L"shared_thumbnails", shared_thumbnails_map, m_shared_thumbnails);
+	this->openCache();
+
 	ini.setFallbackSection(L"common");
 
 	ini.setSection(L"view");
@@ -802,6 +872,13 @@ void DIP::Master::saveConfig()
 	ini.setEnum(L"log", log_levels_map, Log.level());
 	ini.setString(L"log_file", m_log_file);
 
+	ini.setBool(L"cache", m_cache_enabled);
+	ini.setString(L"cache_path", m_cache_path);
+	ini.setUInt(L"cache_size", m_cache_size);
+	ini.setUInt(L"memory_cache", m_memory_cache_size);
+	ini.setUInt(L"preview_memory", m_preview_memory);
+	ini.setEnum(L"shared_thumbnails", shared_thumbnails_map, m_shared_thumbnails);
+
 	ini.setFallbackSection(L"common");
 
 	ini.setSection(L"view");
@@ -813,6 +890,36 @@ void DIP::Master::saveConfig()
 	ini.save(m_basepath + L"DirImage.ini");
 }
 
+void DIP::Master::openCache()
+{
+	m_memory_cache.reset();
+	if (m_memory_cache_size) {
+		m_memory_cache = std::make_shared<DIP::MemoryThumbCache>(static_cast<size_t>(m_memory_cache_size) * 1024 * 1024);
+	}
+
+	m_previews.reset(m_preview_memory ? new DIP::ImageCache(static_cast<size_t>(m_preview_memory) * 1024 * 1024) : nullptr);
+
+	m_shared_cache.reset();
+	if (m_shared_thumbnails != DIP::SHARED_THUMBNAILS_NONE) {
+		m_shared_cache = std::make_shared<DIP::XdgThumbCache>(m_shared_thumbnails == DIP::SHARED_THUMBNAILS_WRITE);
+	}
+
+	m_cache.reset();
+	if (m_cache_enabled == false || m_cache_size == 0) {
+		return;
+	}
+
+	std::wstring directory = m_cache_path.empty() ? L"DirImage.cache" : m_cache_path;
+	// the absolute paths start with a drive or a network share
+	bool absolute = (directory.size() > 1 && directory[1] == L':') || directory.compare(0, 2, L"\\\\") == 0;
+	if (absolute == false) {
+		directory = m_basepath + directory;
+	}
+
+	// the directory is created when the first thumbnail is stored
+	m_cache = std::make_shared<DIP::ThumbCache>(directory, static_cast<size_t>(m_cache_size) * 1024 * 1024);
+}
+
 static const std::unordered_map<const wchar_t *, unsigned int> filters_map = {
 	{L"box",        DIP_IMAGE_FILTER_BOX},
 	{L"bicubic",    DIP_IMAGE_FILTER_BICUBIC},
@@ -836,6 +943,7 @@ void DIP::Master::loadShowConfig(const INI &ini, ShowConfig &config) const
 	ini.readColor(L"background", config.background);
 
 	ini.readEnum(L"filter", filters_map, config.filter);
+	ini.readBool(L"auto_filter", config.auto_filter);
 
 	ini.readBool(L"enlarge", config.enlarge);
 	ini.readBool(L"transparency_grid", config.transparency_grid);
@@ -847,6 +955,13 @@ void DIP::Master::loadShowConfig(const INI &ini, ShowConfig &config) const
 
 	ini.readUInt(L"files_limit", config.files_limit);
 	ini.readUInt(L"shift", config.shift);
+	ini.readBool(L"probe", config.probe);
+	ini.readBool(L"keep_images", config.keep_images);
+	ini.readUInt(L"deadline", config.deadline);
+	ini.readUInt(L"prefetch", config.prefetch);
+	ini.readBool(L"prefetch_previous", config.prefetch_previous);
+	ini.readUInt(L"prefetch_memory", config.prefetch_memory);
+	ini.readBool(L"quantize", config.quantize);
 
 	ini.readBool(L"deep_scan", config.deep_scan);
 	ini.readUInt(L"deep_scan_level", config.deep_scan_level);
@@ -872,6 +987,7 @@ void DIP::Master::saveShowConfig(INI &ini, const ShowConfig &config) const
 	ini.setColor(L"background", config.background);
 
 	ini.setEnum(L"filter", filters_map, config.filter);
+	ini.setBool(L"auto_filter", config.auto_filter);
 
 	ini.setBool(L"enlarge", config.enlarge);
 	ini.setBool(L"transparency_grid", config.transparency_grid);
@@ -883,6 +999,13 @@ void DIP::Master::saveShowConfig(INI &ini, const ShowConfig &config) const
 
 	ini.setUInt(L"files_limit", config.files_limit);
 	ini.setUInt(L"shift", config.shift);
+	ini.setBool(L"probe", config.probe);
+	ini.setBool(L"keep_images", config.keep_images);
+	ini.setUInt(L"deadline", config.deadline);
+	ini.setUInt(L"prefetch", config.prefetch);
+	ini.setBool(L"prefetch_previous", config.prefetch_previous);
+	ini.setUInt(L"prefetch_memory", config.prefetch_memory);
+	ini.setBool(L"quantize", config.quantize);
 
 	ini.setBool(L"deep_scan", config.deep_scan);
 	ini.setUInt(L"deep_scan_level", config.deep_scan_level);
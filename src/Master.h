@@ -3,8 +3,12 @@
 
 #include "Singleton.h"
 #include "Thumbs.h"
+#include "ThumbCache.h"
+#include "MemoryThumbCache.h"
+#include "ImageCache.h"
 #include "L10n.h"
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -22,6 +26,7 @@ namespace DIP {
 		bool adaptive = true;
 		RGBQUAD background = {0, 0, 0, 0};
 		unsigned int filter = 0; // DIP_IMAGE_FILTER_BOX
+		bool auto_filter = true;
 		bool enlarge = false;
 		bool ignore_dots = true;
 		bool transparency_grid = true;
@@ -29,6 +34,13 @@ namespace DIP {
 		unsigned int pad_v = 1;
 		unsigned int files_limit = 1000;
 		unsigned int shift = 0;
+		bool probe = false;
+		bool keep_images = true;
+		unsigned int deadline = 100;
+		unsigned int prefetch = 1;
+		bool prefetch_previous = false;
+		unsigned int prefetch_memory = 128; // megabytes
+		bool quantize = false;
 
 		bool deep_scan = false;
 		unsigned int deep_scan_level = 1;
@@ -40,6 +52,13 @@ namespace DIP {
 		unsigned int info_size = 16;
 	};
 
+	// the use of the freedesktop.org thumbnails shared with the file managers (under Wine)
+	enum SharedThumbnails {
+		SHARED_THUMBNAILS_NONE,
+		SHARED_THUMBNAILS_READ,
+		SHARED_THUMBNAILS_WRITE
+	};
+
 	class INI;
 
 	class Master : public Singleton<Master>
@@ -70,7 +89,8 @@ namespace DIP {
 
 		HWND m_tooltip = nullptr;
 		TOOLINFO m_tooltip_info;
-		Image *m_tooltip_image = nullptr;
+		int m_tooltip_index = -1;
+		bool m_tooltip_known = false;
 
 		bool m_tracking_mouse = false;
 
@@ -81,7 +101,7 @@ namespace DIP {
 		HWND createTrackingToolTip(HWND hwnd, const wchar_t *text);
 
 		static std::vector<std::wstring> scan(const wchar_t *path, const ShowConfig &config);
-		static DIP::Thumbs *prepareThumbs(const wchar_t *path, int width, int height, const ShowConfig &config);
+		DIP::Thumbs *prepareThumbs(const wchar_t *path, int width, int height, const ShowConfig &config) const;
 
 		static LRESULT CALLBACK ListerWindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
 
@@ -111,6 +131,25 @@ namespace DIP {
 		Language m_language = LANG_EN;
 		std::wstring m_log_file;
 
+		bool m_cache_enabled = true;
+		// relative to the plugin folder, DirImage.cache if empty
+		std::wstring m_cache_path;
+		unsigned int m_cache_size = 256; // megabytes
+		std::shared_ptr<DIP::ThumbCache> m_cache;
+
+		// the packed thumbnails shared by all the views and previews of the process
+		unsigned int m_memory_cache_size = 64; // megabytes
+		std::shared_ptr<DIP::MemoryThumbCache> m_memory_cache;
+
+		// the finished folder previews of the thumbnail mode, the panels request them again on every scroll
+		unsigned int m_preview_memory = 32; // megabytes
+		std::unique_ptr<DIP::ImageCache> m_previews;
+
+		unsigned int m_shared_thumbnails = SHARED_THUMBNAILS_NONE;
+		std::shared_ptr<DIP::XdgThumbCache> m_shared_cache;
+
+		void openCache();
+
 		friend class Singleton<Master>;
 	};
 
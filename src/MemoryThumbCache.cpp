@@ -0,0 +1,265 @@
+#include "MemoryThumbCache.h"
+
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+	// the row is packed by the blocks of bytes, the modes of four blocks take one byte before them
+	const size_t BLOCK = 16;
+
+	enum BlockMode {
+		// all the deltas are zero, nothing follows
+		BLOCK_ZERO = 0,
+		// the deltas fit into 4 bits, two of them per byte
+		BLOCK_NIBBLES = 1,
+		BLOCK_RAW = 2
+	};
+
+	// the lists and the index take their nodes besides the entry itself
+	const size_t ENTRY_OVERHEAD = 64;
+
+	// the byte minus the same channel of the previous pixel, the small negative and positive deltas both get the small codes
+	void packRow(const unsigned char *row, size_t length, size_t channels, std::vector<unsigned char> &data)
+	{
+		unsigned char codes[BLOCK];
+		size_t modes = 0;
+		int slot = 4;
+
+		for (size_t start = 0; start < length; start += BLOCK) {
+			size_t count = length - start < BLOCK ? length - start : BLOCK;
+			bool zero = true;
+			bool small = true;
+			for (size_t i = 0; i < count; ++i) {
+				size_t at = start + i;
+				unsigned char delta = static_cast<unsigned char>(at < channels ? row[at] : row[at] - row[at - channels]);
+				unsigned char code = static_cast<unsigned char>((delta << 1) ^ (static_cast<signed char>(delta) >> 7));
+				codes[i] = code;
+				zero = zero && code == 0;
+				small = small && code < 16;
+			}
+
+			if (slot == 4) {
+				modes = data.size();
+				data.push_back(0);
+				slot = 0;
+			}
+			BlockMode mode = zero ? BLOCK_ZERO : (small ? BLOCK_NIBBLES : BLOCK_RAW);
+			data[modes] |= static_cast<unsigned char>(mode << (slot * 2));
+			++slot;
+
+			if (mode == BLOCK_NIBBLES) {
+				for (size_t i = 0; i < count; i += 2) {
+					data.push_back(static_cast<unsigned char>(codes[i] | (i + 1 < count ? codes[i + 1] << 4 : 0)));
+				}
+			} else if (mode == BLOCK_RAW) {
+				data.insert(data.end(), codes, codes + count);
+			}
+		}
+	}
+
+	// reads the rows in the order they were packed, the bounds are checked, so a broken entry is only a miss
+	class Unpacker
+	{
+	public:
+		Unpacker(const std::vector<unsigned char> &data, size_t length, size_t channels) :
+			m_data(data), m_length(length), m_channels(channels)
+		{
+		}
+
+		bool row(unsigned char *row)
+		{
+			unsigned char modes = 0;
+			int slot = 4;
+
+			for (size_t start = 0; start < m_length; start += BLOCK) {
+				size_t count = m_length - start < BLOCK ? m_length - start : BLOCK;
+				if (slot == 4) {
+					if (m_position >= m_data.size()) {
+						return false;
+					}
+					modes = m_data[m_position++];
+					slot = 0;
+				}
+				int mode = (modes >> (slot * 2)) & 3;
+				++slot;
+
+				unsigned char *codes = row + start;
+				if (mode == BLOCK_ZERO) {
+					memset(codes, 0, count);
+				} else if (mode == BLOCK_NIBBLES) {
+					size_t size = (count + 1) / 2;
+					if (m_data.size() - m_position < size) {
+						return false;
+					}
+					for (size_t i = 0; i < count; ++i) {
+						codes[i] = (m_data[m_position + i / 2] >> ((i & 1) * 4)) & 15;
+					}
+					m_position += size;
+				} else if (mode == BLOCK_RAW) {
+					if (m_data.size() - m_position < count) {
+						return false;
+					}
+					memcpy(codes, m_data.data() + m_position, count);
+					m_position += count;
+				} else {
+					return false;
+				}
+			}
+
+			// the codes are turned back into the deltas and the deltas into the bytes in place
+			for (size_t at = 0; at < m_length; ++at) {
+				unsigned char code = row[at];
+				unsigned char delta = static_cast<unsigned char>((code >> 1) ^ (0 - (code & 1)));
+				row[at] = static_cast<unsigned char>(at < m_channels ? delta : row[at - m_channels] + delta);
+			}
+			return true;
+		}
+
+	private:
+		const std::vector<unsigned char> &m_data;
+		size_t m_length;
+		size_t m_channels;
+		size_t m_position = 0;
+	};
+
+} // namespace
+
+DIP::MemoryThumbCache::MemoryThumbCache(size_t budget) :
+	m_budget(budget), m_shard_budget(budget / DIP_MEMORY_THUMB_CACHE_SHARDS)
+{
+}
+
+size_t DIP::MemoryThumbCache::budget() const
+{
+	return m_budget;
+}
+
+size_t DIP::MemoryThumbCache::used()
+{
+	size_t used = 0;
+	for (Shard &shard : m_shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		used += shard.used;
+	}
+	return used;
+}
+
+DIP::MemoryThumbCache::Shard &DIP::MemoryThumbCache::shard(const std::wstring &key)
+{
+	return m_shards[std::hash<std::wstring>()(key) % DIP_MEMORY_THUMB_CACHE_SHARDS];
+}
+
+void DIP::MemoryThumbCache::erase(Shard &shard, List::iterator entry)
+{
+	shard.used -= entry->cost;
+	shard.index.erase(entry->key);
+	shard.list.erase(entry);
+}
+
+DIP::Image *DIP::MemoryThumbCache::load(const std::wstring &filename, const std::wstring &settings, DIP::ImageInfo &info)
+{
+	DIP::ThumbCache::Stamp current;
+	if (m_shard_budget == 0 || DIP::ThumbCache::stamp(filename, current) == false) {
+		return nullptr;
+	}
+
+	std::wstring key = DIP::ThumbCache::key(filename, settings);
+	Shard &shard = this->shard(key);
+
+	Entry entry;
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			return nullptr;
+		}
+		// the image has been changed since the thumbnail was stored
+		if (it->second->stamp.size != current.size || it->second->stamp.time != current.time) {
+			erase(shard, it->second);
+			return nullptr;
+		}
+		shard.list.splice(shard.list.begin(), shard.list, it->second);
+
+		entry.width = it->second->width;
+		entry.height = it->second->height;
+		entry.channels = it->second->channels;
+		entry.info = it->second->info;
+		entry.data = it->second->data;
+	}
+
+	size_t length = static_cast<size_t>(entry.width) * entry.channels;
+	Unpacker unpacker(*entry.data, length, entry.channels);
+	DIP::Image *image = new DIP::Image(entry.width, entry.height, entry.channels, [&unpacker] (int, unsigned char *row) {
+		return unpacker.row(row);
+	});
+
+	if (image->isInitialized() == false) {
+		delete image;
+		return nullptr;
+	}
+
+	info = entry.info;
+	return image;
+}
+
+void DIP::MemoryThumbCache::store(const std::wstring &filename, const std::wstring &settings, const DIP::Image &thumb, const DIP::ImageInfo &info)
+{
+	int channels = thumb.channels();
+	DIP::ThumbCache::Stamp current;
+	if (m_shard_budget == 0 || channels == 0 || DIP::ThumbCache::stamp(filename, current) == false) {
+		return;
+	}
+
+	size_t length = static_cast<size_t>(thumb.width()) * channels;
+	std::vector<unsigned char> packed;
+	packed.reserve(length * thumb.height() / 2);
+	for (int line = 0; line < thumb.height(); ++line) {
+		packRow(thumb.row(line), length, channels, packed);
+	}
+
+	Entry entry;
+	entry.key = DIP::ThumbCache::key(filename, settings);
+	entry.stamp = current;
+	entry.width = thumb.width();
+	entry.height = thumb.height();
+	entry.channels = channels;
+	entry.info = info;
+	// copied to drop the spare capacity
+	entry.data = std::make_shared<const std::vector<unsigned char>>(packed.begin(), packed.end());
+	// the key is held by the entry and by the index
+	entry.cost = packed.size() + entry.key.size() * sizeof(wchar_t) * 2 + sizeof(Entry) + ENTRY_OVERHEAD;
+
+	if (entry.cost > m_shard_budget) {
+		return;
+	}
+
+	Shard &shard = this->shard(entry.key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto it = shard.index.find(entry.key);
+	if (it != shard.index.end()) {
+		erase(shard, it->second);
+	}
+
+	size_t cost = entry.cost;
+	shard.list.push_front(std::move(entry));
+	shard.index[shard.list.front().key] = shard.list.begin();
+	shard.used += cost;
+
+	while (shard.used > m_shard_budget) {
+		erase(shard, std::prev(shard.list.end()));
+	}
+}
+
+void DIP::MemoryThumbCache::clear()
+{
+	for (Shard &shard : m_shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.list.clear();
+		shard.index.clear();
+		shard.used = 0;
+	}
+}
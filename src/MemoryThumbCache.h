@@ -0,0 +1,78 @@
+#ifndef DIP_MEMORYTHUMBCACHE_H
+#define DIP_MEMORYTHUMBCACHE_H
+
+#include "Image.h"
+#include "ThumbCache.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+
+// the entries are split by the hash of the key, each part has its own lock and its own share of the budget,
+// so the workers looking up the thumbnails rarely wait for each other
+#define DIP_MEMORY_THUMB_CACHE_SHARDS 16
+
+namespace DIP {
+
+	// the thumbnails kept in memory for the whole process, packed by the lossless delta coding; an entry is used while
+	// the image file keeps its size and modification time, the least recently used ones are dropped when the packed
+	// data outgrows the budget
+	class MemoryThumbCache
+	{
+	public:
+		// the budget is in bytes, it covers the packed pixels and the bookkeeping of the entries
+		MemoryThumbCache(size_t budget);
+
+		MemoryThumbCache(const MemoryThumbCache&) = delete;
+		MemoryThumbCache& operator=(const MemoryThumbCache&) = delete;
+
+		size_t budget() const;
+		size_t used();
+
+		// returns nullptr when there is no thumbnail for the current version of the file,
+		// the pixels are unpacked straight into the rows of the returned image
+		DIP::Image *load(const std::wstring &filename, const std::wstring &settings, DIP::ImageInfo &info);
+		// the images of the formats other than gray, BGR and BGRA are not stored
+		void store(const std::wstring &filename, const std::wstring &settings, const DIP::Image &thumb, const DIP::ImageInfo &info);
+		void clear();
+
+	private:
+		struct Entry {
+			std::wstring key;
+			DIP::ThumbCache::Stamp stamp;
+			int width = 0;
+			int height = 0;
+			int channels = 0;
+			DIP::ImageInfo info;
+			// shared with the readers, so it is unpacked outside of the lock
+			std::shared_ptr<const std::vector<unsigned char>> data;
+			size_t cost = 0;
+		};
+
+		typedef std::list<Entry> List;
+
+		struct Shard {
+			std::mutex mutex;
+			// the most recently used first
+			List list;
+			std::unordered_map<std::wstring, List::iterator> index;
+			size_t used = 0;
+		};
+
+		Shard &shard(const std::wstring &key);
+		// the lock of the shard is held by the caller
+		static void erase(Shard &shard, List::iterator entry);
+
+		size_t m_budget;
+		size_t m_shard_budget;
+
+		Shard m_shards[DIP_MEMORY_THUMB_CACHE_SHARDS];
+	};
+
+} // namespace DIP
+
+#endif // DIP_MEMORYTHUMBCACHE_H
@@ -0,0 +1,594 @@
+#include "Resampler.h"
+#include "Image.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIP_RESAMPLER_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsics as is, GCC needs to be allowed to use them in the particular functions
+#if defined(DIP_RESAMPLER_X86) && defined(__GNUC__)
+#define DIP_TARGET_SSE2 __attribute__((target("sse2")))
+#define DIP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DIP_TARGET_SSE2
+#define DIP_TARGET_AVX2
+#endif
+
+namespace {
+
+	const double pi = 3.14159265358979323846;
+
+	// the filters are the same as the FreeImage ones, so the results match FreeImage_Rescale
+	double filterWidth(int filter)
+	{
+		switch (filter) {
+			case DIP_IMAGE_FILTER_BILINEAR:
+				return 1;
+			case DIP_IMAGE_FILTER_BICUBIC:
+			case DIP_IMAGE_FILTER_BSPLINE:
+			case DIP_IMAGE_FILTER_CATMULLROM:
+				return 2;
+			case DIP_IMAGE_FILTER_LANCZOS3:
+				return 3;
+			default:
+				return 0.5;
+		}
+	}
+
+	double sinc(double x)
+	{
+		x *= pi;
+		return x != 0 ? sin(x) / x : 1;
+	}
+
+	double filterValue(int filter, double x)
+	{
+		double t = fabs(x);
+
+		switch (filter) {
+			case DIP_IMAGE_FILTER_BILINEAR:
+				return t < 1 ? 1 - t : 0;
+
+			case DIP_IMAGE_FILTER_BICUBIC: {
+				// Mitchell-Netravali with B = C = 1/3
+				const double b = 1.0 / 3;
+				const double c = 1.0 / 3;
+				if (t < 1) {
+					return ((6 - 2 * b) + t * t * ((-18 + 12 * b + 6 * c) + t * (12 - 9 * b - 6 * c))) / 6;
+				}
+				if (t < 2) {
+					return ((8 * b + 24 * c) + t * ((-12 * b - 48 * c) + t * ((6 * b + 30 * c) + t * (-b - 6 * c)))) / 6;
+				}
+				return 0;
+			}
+
+			case DIP_IMAGE_FILTER_BSPLINE:
+				if (t < 1) {
+					return 2.0 / 3 + (0.5 * t * t * t - t * t);
+				}
+				if (t < 2) {
+					t = 2 - t;
+					return t * t * t / 6;
+				}
+				return 0;
+
+			case DIP_IMAGE_FILTER_CATMULLROM:
+				if (t < 1) {
+					return 0.5 * (2 + t * t * (-5 + 3 * t));
+				}
+				if (t < 2) {
+					return 0.5 * (4 + t * (-8 + t * (5 - t)));
+				}
+				return 0;
+
+			case DIP_IMAGE_FILTER_LANCZOS3:
+				return t < 3 ? sinc(x) * sinc(x / 3) : 0;
+
+			default:
+				return t <= 0.5 ? 1 : 0;
+		}
+	}
+
+	inline unsigned char clamp(int value)
+	{
+		value >>= DIP_RESAMPLER_PRECISION;
+		return static_cast<unsigned char>(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+
+	const int rounding = 1 << (DIP_RESAMPLER_PRECISION - 1);
+
+	typedef void (*HorizontalKernel)(const unsigned char *source, int source_width, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps);
+	typedef void (*VerticalKernel)(const unsigned char *const *rows, const int16_t *weights, int taps, unsigned char *destination, int bytes);
+
+	struct Kernels {
+		const char *name;
+		// indexed by the number of the channels
+		HorizontalKernel horizontal[5];
+		VerticalKernel vertical;
+	};
+
+	template <int channels>
+	void horizontalScalar(const unsigned char *source, int /*source_width*/, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps)
+	{
+		for (int x = 0; x < width; ++x) {
+			const unsigned char *pixels = source + offsets[x] * channels;
+			const int16_t *w = weights + x * taps;
+			int sums[channels];
+			for (int c = 0; c < channels; ++c) {
+				sums[c] = rounding;
+			}
+			for (int k = 0; k < taps; ++k) {
+				for (int c = 0; c < channels; ++c) {
+					sums[c] += pixels[k * channels + c] * w[k];
+				}
+			}
+			for (int c = 0; c < channels; ++c) {
+				destination[x * channels + c] = clamp(sums[c]);
+			}
+		}
+	}
+
+	HorizontalKernel horizontalScalar(int channels)
+	{
+		return channels == 1 ? horizontalScalar<1> : (channels == 3 ? horizontalScalar<3> : horizontalScalar<4>);
+	}
+
+	// the bytes [begin, end) of the row
+	void verticalRange(const unsigned char *const *rows, const int16_t *weights, int taps, unsigned char *destination, int begin, int end)
+	{
+		for (int x = begin; x < end; ++x) {
+			int sum = rounding;
+			for (int k = 0; k < taps; ++k) {
+				sum += rows[k][x] * weights[k];
+			}
+			destination[x] = clamp(sum);
+		}
+	}
+
+	void verticalScalar(const unsigned char *const *rows, const int16_t *weights, int taps, unsigned char *destination, int bytes)
+	{
+		verticalRange(rows, weights, taps, destination, 0, bytes);
+	}
+
+#ifdef DIP_RESAMPLER_X86
+
+	// two weights in each 32-bit element, the pairs of pixels are multiplied by them with _mm_madd_epi16
+	inline int weightPair(const int16_t *weights)
+	{
+		return static_cast<int>(static_cast<uint16_t>(weights[0]) | (static_cast<uint32_t>(static_cast<uint16_t>(weights[1])) << 16));
+	}
+
+	inline int loadInt(const unsigned char *data)
+	{
+		int value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	DIP_TARGET_SSE2 inline void storeInt(unsigned char *data, __m128i value)
+	{
+		int result = _mm_cvtsi128_si32(value);
+		memcpy(data, &result, sizeof(result));
+	}
+
+	DIP_TARGET_SSE2 void horizontal1Sse2(const unsigned char *source, int /*source_width*/, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (int x = 0; x < width; ++x) {
+			const unsigned char *pixels = source + offsets[x];
+			const int16_t *w = weights + x * taps;
+			__m128i sum = zero;
+			for (int k = 0; k < taps; k += 4) {
+				__m128i values = _mm_unpacklo_epi8(_mm_cvtsi32_si128(loadInt(pixels + k)), zero);
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(values, _mm_loadl_epi64(reinterpret_cast<const __m128i *>(w + k))));
+			}
+			sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+			destination[x] = clamp(_mm_cvtsi128_si32(sum) + rounding);
+		}
+	}
+
+	// the pixel is read as 4 bytes, so the pixels near the end of the row are left to the scalar code
+	DIP_TARGET_SSE2 void horizontal3Sse2(const unsigned char *source, int source_width, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (int x = 0; x < width; ++x) {
+			if (offsets[x] + taps >= source_width) {
+				horizontalScalar<3>(source, source_width, destination + x * 3, 1, offsets + x, weights + x * taps, taps);
+				continue;
+			}
+			const unsigned char *pixels = source + offsets[x] * 3;
+			const int16_t *w = weights + x * taps;
+			__m128i sum = _mm_set1_epi32(rounding);
+			for (int k = 0; k < taps; k += 2) {
+				__m128i first = _mm_unpacklo_epi8(_mm_cvtsi32_si128(loadInt(pixels + k * 3)), zero);
+				__m128i second = _mm_unpacklo_epi8(_mm_cvtsi32_si128(loadInt(pixels + k * 3 + 3)), zero);
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(first, second), _mm_set1_epi32(weightPair(w + k))));
+			}
+			sum = _mm_srai_epi32(sum, DIP_RESAMPLER_PRECISION);
+			sum = _mm_packs_epi32(sum, sum);
+			sum = _mm_packus_epi16(sum, sum);
+			int result = _mm_cvtsi128_si32(sum);
+			memcpy(destination + x * 3, &result, 3);
+		}
+	}
+
+	DIP_TARGET_SSE2 void horizontal4Sse2(const unsigned char *source, int /*source_width*/, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (int x = 0; x < width; ++x) {
+			const unsigned char *pixels = source + offsets[x] * 4;
+			const int16_t *w = weights + x * taps;
+			__m128i sum = _mm_set1_epi32(rounding);
+			for (int k = 0; k < taps; k += 2) {
+				// the same channels of the both pixels go in pairs
+				__m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pixels + k * 4)), zero);
+				values = _mm_unpacklo_epi16(values, _mm_srli_si128(values, 8));
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(values, _mm_set1_epi32(weightPair(w + k))));
+			}
+			sum = _mm_srai_epi32(sum, DIP_RESAMPLER_PRECISION);
+			sum = _mm_packs_epi32(sum, sum);
+			storeInt(destination + x * 4, _mm_packus_epi16(sum, sum));
+		}
+	}
+
+	DIP_TARGET_SSE2 void verticalSse2(const unsigned char *const *rows, const int16_t *weights, int taps, unsigned char *destination, int bytes)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(rounding);
+		int x = 0;
+		for (; x + 16 <= bytes; x += 16) {
+			__m128i sums[4] = {round, round, round, round};
+			for (int k = 0; k < taps; k += 2) {
+				__m128i coefficients = _mm_set1_epi32(weightPair(weights + k));
+				__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k] + x));
+				__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[k + 1] + x));
+				__m128i low = _mm_unpacklo_epi8(first, second);
+				__m128i high = _mm_unpackhi_epi8(first, second);
+				sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), coefficients));
+				sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), coefficients));
+				sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), coefficients));
+				sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), coefficients));
+			}
+			for (__m128i &sum : sums) {
+				sum = _mm_srai_epi32(sum, DIP_RESAMPLER_PRECISION);
+			}
+			__m128i result = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + x), result);
+		}
+
+		verticalRange(rows, weights, taps, destination, x, bytes);
+	}
+
+	DIP_TARGET_AVX2 void horizontal4Avx2(const unsigned char *source, int /*source_width*/, unsigned char *destination, int width, const int *offsets, const int16_t *weights, int taps)
+	{
+		for (int x = 0; x < width; ++x) {
+			const unsigned char *pixels = source + offsets[x] * 4;
+			const int16_t *w = weights + x * taps;
+			__m256i sum = _mm256_setzero_si256();
+			for (int k = 0; k < taps; k += 4) {
+				// the pixels 0 and 1 go to the low lane, 2 and 3 to the high one
+				__m256i values = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + k * 4)));
+				values = _mm256_unpacklo_epi16(values, _mm256_srli_si256(values, 8));
+				__m256i coefficients = _mm256_setr_epi32(
+					weightPair(w + k), weightPair(w + k), weightPair(w + k), weightPair(w + k),
+					weightPair(w + k + 2), weightPair(w + k + 2), weightPair(w + k + 2), weightPair(w + k + 2)
+				);
+				sum = _mm256_add_epi32(sum, _mm256_madd_epi16(values, coefficients));
+			}
+			__m128i result = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+			result = _mm_srai_epi32(_mm_add_epi32(result, _mm_set1_epi32(rounding)), DIP_RESAMPLER_PRECISION);
+			result = _mm_packs_epi32(result, result);
+			result = _mm_packus_epi16(result, result);
+			int value = _mm_cvtsi128_si32(result);
+			memcpy(destination + x * 4, &value, sizeof(value));
+		}
+	}
+
+	DIP_TARGET_AVX2 void verticalAvx2(const unsigned char *const *rows, const int16_t *weights, int taps, unsigned char *destination, int bytes)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i round = _mm256_set1_epi32(rounding);
+		int x = 0;
+		// the unpacking and the packing work within the lanes, so the order of the bytes is kept
+		for (; x + 32 <= bytes; x += 32) {
+			__m256i sums[4] = {round, round, round, round};
+			for (int k = 0; k < taps; k += 2) {
+				__m256i coefficients = _mm256_set1_epi32(weightPair(weights + k));
+				__m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k] + x));
+				__m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[k + 1] + x));
+				__m256i low = _mm256_unpacklo_epi8(first, second);
+				__m256i high = _mm256_unpackhi_epi8(first, second);
+				sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), coefficients));
+				sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), coefficients));
+				sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), coefficients));
+				sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), coefficients));
+			}
+			for (__m256i &sum : sums) {
+				sum = _mm256_srai_epi32(sum, DIP_RESAMPLER_PRECISION);
+			}
+			__m256i result = _mm256_packus_epi16(_mm256_packs_epi32(sums[0], sums[1]), _mm256_packs_epi32(sums[2], sums[3]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + x), result);
+		}
+
+		verticalRange(rows, weights, taps, destination, x, bytes);
+	}
+
+	enum InstructionSet {
+		INSTRUCTIONS_SCALAR,
+		INSTRUCTIONS_SSE2,
+		INSTRUCTIONS_AVX2
+	};
+
+	InstructionSet detectInstructionSet()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int ids = info[0];
+
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+
+		// the system has to save the AVX registers as well
+		if (ids >= 7 && avx && osxsave && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5)) {
+				return INSTRUCTIONS_AVX2;
+			}
+		}
+		return sse2 ? INSTRUCTIONS_SSE2 : INSTRUCTIONS_SCALAR;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return INSTRUCTIONS_AVX2;
+		}
+		return __builtin_cpu_supports("sse2") ? INSTRUCTIONS_SSE2 : INSTRUCTIONS_SCALAR;
+#endif
+	}
+
+#endif // DIP_RESAMPLER_X86
+
+	Kernels selectKernels()
+	{
+		Kernels kernels = {
+			"scalar",
+			{nullptr, horizontalScalar<1>, nullptr, horizontalScalar<3>, horizontalScalar<4>},
+			verticalScalar
+		};
+
+#ifdef DIP_RESAMPLER_X86
+		InstructionSet set = detectInstructionSet();
+
+		if (set >= INSTRUCTIONS_SSE2) {
+			kernels.name = "SSE2";
+			kernels.horizontal[1] = horizontal1Sse2;
+			kernels.horizontal[3] = horizontal3Sse2;
+			kernels.horizontal[4] = horizontal4Sse2;
+			kernels.vertical = verticalSse2;
+		}
+
+		if (set >= INSTRUCTIONS_AVX2) {
+			kernels.name = "AVX2";
+			kernels.horizontal[4] = horizontal4Avx2;
+			kernels.vertical = verticalAvx2;
+		}
+#endif
+
+		return kernels;
+	}
+
+	const Kernels &kernels()
+	{
+		static const Kernels kernels = selectKernels();
+		return kernels;
+	}
+
+} // namespace
+
+void DIP::Resampler::Weights::build(int source_size, int size, int filter)
+{
+	double scale = static_cast<double>(size) / source_size;
+	double width = filterWidth(filter);
+	double filter_scale = 1;
+
+	// the filter is stretched over the source pixels when reducing
+	if (scale < 1) {
+		width /= scale;
+		filter_scale = scale;
+	}
+
+	std::vector<int> lefts(size);
+	std::vector<std::vector<double>> values(size);
+
+	taps = 0;
+	for (int u = 0; u < size; ++u) {
+		double center = (u + 0.5) / scale;
+		int left = max(0, static_cast<int>(center - width + 0.5));
+		int right = min(static_cast<int>(center + width + 0.5), source_size);
+
+		std::vector<double> &weights = values[u];
+		double total = 0;
+		for (int i = left; i < right; ++i) {
+			double weight = filter_scale * filterValue(filter, filter_scale * (i + 0.5 - center));
+			weights.push_back(weight);
+			total += weight;
+		}
+
+		// the zero weights at the ends are dropped
+		while (weights.empty() == false && weights.back() == 0) {
+			weights.pop_back();
+		}
+		size_t first = 0;
+		while (first < weights.size() && weights[first] == 0) {
+			++first;
+		}
+		weights.erase(weights.begin(), weights.begin() + first);
+		left += static_cast<int>(first);
+
+		if (weights.empty() || total == 0) {
+			weights.assign(1, 1);
+			left = min(max(0, static_cast<int>(center)), source_size - 1);
+			total = 1;
+		}
+
+		for (double &weight : weights) {
+			weight /= total;
+		}
+
+		lefts[u] = left;
+		taps = max(taps, static_cast<int>(weights.size()));
+	}
+
+	int padded = (taps + 3) & ~3;
+	if (padded <= source_size) {
+		taps = padded;
+	}
+
+	offsets.assign(size, 0);
+	this->values.assign(static_cast<size_t>(size) * taps, 0);
+
+	for (int u = 0; u < size; ++u) {
+		// the window is shifted back at the end of the source, so all the taps are within it
+		int offset = min(lefts[u], source_size - taps);
+		offsets[u] = offset;
+
+		int16_t *fixed = &this->values[static_cast<size_t>(u) * taps];
+		const std::vector<double> &weights = values[u];
+		int shift = lefts[u] - offset;
+
+		int sum = 0;
+		int largest = 0;
+		for (size_t i = 0; i < weights.size(); ++i) {
+			int value = static_cast<int>(lround(weights[i] * (1 << DIP_RESAMPLER_PRECISION)));
+			fixed[shift + i] = static_cast<int16_t>(value);
+			sum += value;
+			if (abs(value) > abs(fixed[shift + largest])) {
+				largest = static_cast<int>(i);
+			}
+		}
+		// the rounding error goes to the largest weight, so a flat area stays flat
+		fixed[shift + largest] = static_cast<int16_t>(fixed[shift + largest] + (1 << DIP_RESAMPLER_PRECISION) - sum);
+	}
+}
+
+bool DIP::Resampler::Weights::isPadded() const
+{
+	return taps % 4 == 0;
+}
+
+DIP::Resampler::Resampler(int source_width, int source_height, int width, int height, int channels, int filter) :
+	m_source_width(source_width), m_source_height(source_height), m_width(width), m_height(height), m_channels(channels)
+{
+	if (this->isValid()) {
+		m_horizontal.build(source_width, width, filter);
+		m_vertical.build(source_height, height, filter);
+	}
+}
+
+bool DIP::Resampler::isValid() const
+{
+	return m_source_width > 0 && m_source_height > 0 && m_width > 0 && m_height > 0 && (m_channels == 1 || m_channels == 3 || m_channels == 4);
+}
+
+int DIP::Resampler::width() const
+{
+	return m_width;
+}
+
+int DIP::Resampler::height() const
+{
+	return m_height;
+}
+
+void DIP::Resampler::resample(const unsigned char *source, size_t source_pitch, unsigned char *destination, size_t destination_pitch, int first, int last) const
+{
+	this->run(plainReader(source, source_pitch), destination, destination_pitch, nullptr, first, last);
+}
+
+void DIP::Resampler::resample(const unsigned char *source, size_t source_pitch, const RowWriter &writer, int first, int last) const
+{
+	this->run(plainReader(source, source_pitch), nullptr, 0, &writer, first, last);
+}
+
+void DIP::Resampler::resample(const RowReader &reader, unsigned char *destination, size_t destination_pitch, int first, int last) const
+{
+	this->run(reader, destination, destination_pitch, nullptr, first, last);
+}
+
+void DIP::Resampler::resample(const RowReader &reader, const RowWriter &writer, int first, int last) const
+{
+	this->run(reader, nullptr, 0, &writer, first, last);
+}
+
+DIP::Resampler::RowReader DIP::Resampler::plainReader(const unsigned char *source, size_t source_pitch)
+{
+	return [source, source_pitch] (int y, unsigned char * /*buffer*/) {
+		return source + y * source_pitch;
+	};
+}
+
+void DIP::Resampler::run(const RowReader &reader, unsigned char *destination, size_t destination_pitch, const RowWriter *writer, int first, int last) const
+{
+	if (this->isValid() == false) {
+		return;
+	}
+	if (last < 0 || last > m_height) {
+		last = m_height;
+	}
+	if (first >= last) {
+		return;
+	}
+
+	const Kernels &selected = kernels();
+
+	// the vector kernels need the padded taps
+	HorizontalKernel horizontal = m_horizontal.isPadded() ? selected.horizontal[m_channels] : horizontalScalar(m_channels);
+	VerticalKernel vertical = m_vertical.isPadded() ? selected.vertical : verticalScalar;
+
+	// only the source rows under the destination ones are scaled horizontally
+	int top = m_vertical.offsets[first];
+	int bottom = top;
+	for (int y = first; y < last; ++y) {
+		top = min(top, m_vertical.offsets[y]);
+		bottom = max(bottom, m_vertical.offsets[y] + m_vertical.taps);
+	}
+
+	size_t bytes = static_cast<size_t>(m_width) * m_channels;
+	std::vector<unsigned char> buffer(bytes * (bottom - top));
+	std::vector<unsigned char> expanded(static_cast<size_t>(m_source_width) * m_channels);
+
+	for (int y = top; y < bottom; ++y) {
+		const unsigned char *row = reader(y, expanded.data());
+		horizontal(row, m_source_width, &buffer[(y - top) * bytes], m_width, m_horizontal.offsets.data(), m_horizontal.values.data(), m_horizontal.taps);
+	}
+
+	std::vector<unsigned char> line(writer ? bytes : 0);
+
+	std::vector<const unsigned char *> rows(m_vertical.taps);
+	for (int y = first; y < last; ++y) {
+		for (int k = 0; k < m_vertical.taps; ++k) {
+			rows[k] = &buffer[(m_vertical.offsets[y] + k - top) * bytes];
+		}
+		unsigned char *result = writer ? line.data() : destination + y * destination_pitch;
+		vertical(rows.data(), &m_vertical.values[static_cast<size_t>(y) * m_vertical.taps], m_vertical.taps, result, static_cast<int>(bytes));
+		if (writer) {
+			(*writer)(result, y);
+		}
+	}
+}
+
+const char *DIP::Resampler::instructionSet()
+{
+	return kernels().name;
+}
@@ -0,0 +1,72 @@
+#ifndef DIP_RESAMPLER_H
+#define DIP_RESAMPLER_H
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// the number of the fractional bits of the fixed-point filter weights
+#define DIP_RESAMPLER_PRECISION 14
+
+namespace DIP {
+
+	// the separable resampler of the images with 8 bits per channel (gray, BGR, BGRA),
+	// runs SSE2 or AVX2 kernels picked by the CPU detection, or the scalar ones
+	class Resampler
+	{
+	public:
+		// receives the resampled destination rows one by one instead of storing them
+		typedef std::function<void(const unsigned char *row, int y)> RowWriter;
+		// gives the source row, it can be expanded into the buffer (the source width times the channels) and returned
+		typedef std::function<const unsigned char *(int y, unsigned char *buffer)> RowReader;
+
+		// the filter is one of DIP_IMAGE_FILTER_*
+		Resampler(int source_width, int source_height, int width, int height, int channels, int filter);
+
+		bool isValid() const;
+
+		int width() const;
+		int height() const;
+
+		// fills the destination rows [first, last), all of them by default, the rows of both images go
+		// in the same order (bottom-up as well as top-down)
+		void resample(const unsigned char *source, size_t source_pitch, unsigned char *destination, size_t destination_pitch, int first = 0, int last = -1) const;
+		// the rows are passed through a single row buffer, so the writer can convert them into the destination
+		void resample(const unsigned char *source, size_t source_pitch, const RowWriter &writer, int first = 0, int last = -1) const;
+		// the source rows are read one by one as they are needed, so the reader can convert them from another format
+		void resample(const RowReader &reader, unsigned char *destination, size_t destination_pitch, int first = 0, int last = -1) const;
+		void resample(const RowReader &reader, const RowWriter &writer, int first = 0, int last = -1) const;
+
+		// the name of the instruction set used by the kernels
+		static const char *instructionSet();
+
+	private:
+		void run(const RowReader &reader, unsigned char *destination, size_t destination_pitch, const RowWriter *writer, int first, int last) const;
+		static RowReader plainReader(const unsigned char *source, size_t source_pitch);
+
+		// the weights of the source pixels for each destination pixel, the count of them is the same for
+		// all the destination pixels (padded with zeros), so the kernels run without the bounds checks
+		struct Weights {
+			int taps = 0;
+			std::vector<int> offsets;
+			std::vector<int16_t> values;
+
+			void build(int source_size, int size, int filter);
+			// the taps are padded to a multiple of 4 for the vector kernels
+			bool isPadded() const;
+		};
+
+		int m_source_width;
+		int m_source_height;
+		int m_width;
+		int m_height;
+		int m_channels;
+
+		Weights m_horizontal;
+		Weights m_vertical;
+	};
+
+} // namespace DIP
+
+#endif // DIP_RESAMPLER_H
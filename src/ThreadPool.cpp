@@ -0,0 +1,231 @@
+#include "ThreadPool.h"
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+// the index of the worker queue owned by the current thread, -1 for the threads outside of the pool
+static thread_local int s_worker = -1;
+
+bool DIP::ThreadPool::Group::isDone() const
+{
+	return m_pending == 0;
+}
+
+DIP::ThreadPool &DIP::ThreadPool::instance()
+{
+	static std::once_flag created;
+	std::call_once(created, [] {
+		Singleton<ThreadPool>::initialize();
+	});
+	return *instancePointer();
+}
+
+DIP::ThreadPool::ThreadPool()
+{
+	size_t size = std::thread::hardware_concurrency();
+	if (size == 0) {
+		size = 1;
+	}
+
+	m_queues.reserve(size);
+	for (size_t i = 0; i < size; ++i) {
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+
+	m_threads.reserve(size);
+	for (size_t i = 0; i < size; ++i) {
+		m_threads.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+}
+
+DIP::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+	m_done.notify_all();
+
+	for (std::thread &thread : m_threads) {
+		thread.join();
+	}
+}
+
+size_t DIP::ThreadPool::size() const
+{
+	return m_threads.size();
+}
+
+void DIP::ThreadPool::submit(Group &group, Task task, Priority priority)
+{
+	++group.m_pending;
+
+	// the workers keep their own subtasks local, the others are spread evenly
+	size_t index = s_worker >= 0 ? static_cast<size_t>(s_worker) : m_next++ % m_queues.size();
+	{
+		Queue &queue = priority == PRIORITY_LOW ? m_background : (priority == PRIORITY_HIGH ? m_foreground : *m_queues[index]);
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		Item item;
+		item.task = std::move(task);
+		item.group = &group;
+		queue.items.push_back(std::move(item));
+		++group.m_queued;
+		++m_pending;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_condition.notify_one();
+}
+
+void DIP::ThreadPool::wait(Group &group)
+{
+	while (group.isDone() == false) {
+		// a worker waiting for its subtasks helps with them, otherwise the pool could run out of threads; the other
+		// tasks (the whole decodes, the prefetch) are left alone, they would nest on its stack and delay the wait
+		Item item;
+		if (s_worker >= 0 && this->pop(item, &group)) {
+			this->run(item);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (s_worker >= 0) {
+			// the new subtasks are announced to the idle workers only, so a helping worker checks for them periodically
+			m_done.wait_for(lock, std::chrono::milliseconds(1), [&group] {
+				return group.isDone() || group.m_queued > 0;
+			});
+		} else {
+			m_done.wait(lock, [&group] {
+				return group.isDone();
+			});
+		}
+	}
+}
+
+bool DIP::ThreadPool::wait(Group &group, unsigned int timeout)
+{
+	if (s_worker >= 0) {
+		// the workers must not wait for anything else but their own subtasks
+		this->wait(group);
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return m_done.wait_for(lock, std::chrono::milliseconds(timeout), [&group] {
+		return group.isDone();
+	});
+}
+
+void DIP::ThreadPool::work(size_t index)
+{
+	s_worker = static_cast<int>(index);
+
+	Item item;
+	while (true) {
+		if (this->pop(item)) {
+			this->run(item);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this] {
+			return m_stop || m_pending > 0;
+		});
+		if (m_stop) {
+			return;
+		}
+	}
+}
+
+bool DIP::ThreadPool::pop(Item &item, const Group *group)
+{
+	// the high priority tasks are run in order of submission
+	if (this->take(m_foreground, item, group, false)) {
+		return true;
+	}
+
+	size_t size = m_queues.size();
+	size_t own = s_worker >= 0 ? static_cast<size_t>(s_worker) : 0;
+
+	// the own queue is used as a stack (the freshest data is still in the cache), the others are robbed from the opposite end
+	for (size_t i = 0; i < size; ++i) {
+		if (this->take(*m_queues[(own + i) % size], item, group, i == 0)) {
+			return true;
+		}
+	}
+
+	// the low priority tasks are run in order of submission
+	return this->take(m_background, item, group, false);
+}
+
+bool DIP::ThreadPool::take(Queue &queue, Item &item, const Group *group, bool back)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.items.empty() || (group && group->m_queued == 0)) {
+		return false;
+	}
+
+	std::deque<Item>::iterator it;
+	if (group == nullptr) {
+		it = back ? std::prev(queue.items.end()) : queue.items.begin();
+	} else if (back) {
+		auto found = std::find_if(queue.items.rbegin(), queue.items.rend(), [group] (const Item &item) {
+			return item.group == group;
+		});
+		if (found == queue.items.rend()) {
+			return false;
+		}
+		it = std::prev(found.base());
+	} else {
+		it = std::find_if(queue.items.begin(), queue.items.end(), [group] (const Item &item) {
+			return item.group == group;
+		});
+		if (it == queue.items.end()) {
+			return false;
+		}
+	}
+
+	item = std::move(*it);
+	queue.items.erase(it);
+	--item.group->m_queued;
+	--m_pending;
+	return true;
+}
+
+void DIP::ThreadPool::run(Item &item)
+{
+	// the group is released whatever the task throws, otherwise its waiters would hang
+	struct Release {
+		ThreadPool *pool;
+		Item &item;
+
+		~Release()
+		{
+			if (--item.group->m_pending == 0) {
+				{
+					std::lock_guard<std::mutex> lock(pool->m_mutex);
+				}
+				pool->m_done.notify_all();
+			}
+
+			// the task may hold the last reference to the owner of its group, so it goes after the group is released
+			item.task = nullptr;
+			item.group = nullptr;
+		}
+	} release {this, item};
+
+	try {
+		item.task();
+	} catch (const std::exception &exception) {
+		Log.error(L"Thread pool task exception | %S", exception.what());
+	} catch (...) {
+		// the decoders and the translated structured exceptions throw the other types
+		Log.error(L"Thread pool task unknown exception");
+	}
+}
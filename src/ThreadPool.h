@@ -0,0 +1,102 @@
+#ifndef DIP_THREADPOOL_H
+#define DIP_THREADPOOL_H
+
+#include "Singleton.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DIP {
+
+	// the process-wide pool of worker threads, each worker has its own queue and steals from the others when idle
+	class ThreadPool : public SingletonDefault<ThreadPool>
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		// the low priority tasks are taken only when there is nothing else to do, the high priority ones
+		// (the short tasks the others are waited for with, like reading the headers) before anything else
+		enum Priority {
+			PRIORITY_NORMAL,
+			PRIORITY_LOW,
+			PRIORITY_HIGH
+		};
+
+		// the set of tasks that can be waited for together
+		class Group
+		{
+		public:
+			Group() = default;
+			Group(const Group&) = delete;
+			Group& operator=(const Group&) = delete;
+
+			bool isDone() const;
+
+		private:
+			std::atomic<int> m_pending {0};
+			// the tasks still in the queues, a waiting worker looks for them
+			std::atomic<int> m_queued {0};
+
+			friend class ThreadPool;
+		};
+
+		~ThreadPool();
+
+		// the pool is created once on the first use, which may come from several threads at once
+		// (the preview threads of the host and the window thread)
+		static ThreadPool &instance();
+
+		size_t size() const;
+
+		void submit(Group &group, Task task, Priority priority = PRIORITY_NORMAL);
+		// a worker waiting for the group runs the tasks of this group only, so the wait does not depend on the others
+		void wait(Group &group);
+		// returns false if the group is still not done after the timeout (in milliseconds)
+		bool wait(Group &group, unsigned int timeout);
+
+	private:
+		struct Item {
+			Task task;
+			Group *group = nullptr;
+		};
+
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Item> items;
+		};
+
+		ThreadPool();
+
+		void work(size_t index);
+		// takes any task or, with the group given, a task of this group only
+		bool pop(Item &item, const Group *group = nullptr);
+		bool take(Queue &queue, Item &item, const Group *group, bool back);
+		void run(Item &item);
+
+		std::vector<std::thread> m_threads;
+		std::vector<std::unique_ptr<Queue>> m_queues;
+		Queue m_foreground;
+		Queue m_background;
+
+		std::atomic<size_t> m_next {0};
+		std::atomic<size_t> m_pending {0};
+
+		std::mutex m_mutex;
+		// signals the workers about the new tasks
+		std::condition_variable m_condition;
+		// signals the waiters about the finished groups
+		std::condition_variable m_done;
+		bool m_stop = false;
+
+		friend class Singleton<ThreadPool>;
+	};
+
+} // namespace DIP
+
+#endif // DIP_THREADPOOL_H
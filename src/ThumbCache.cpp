@@ -0,0 +1,303 @@
+#include "ThumbCache.h"
+
+#include "FileIterator.h"
+#include "MappedFile.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <vector>
+
+namespace {
+
+	const char MAGIC[4] = {'D', 'I', 'P', 'T'};
+	const uint32_t VERSION = 1;
+	const wchar_t *EXTENSION = L"thumb";
+
+	// followed by the key and the packed rows of the pixels (bottom-up)
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t size;
+		uint64_t time;
+		int32_t width;
+		int32_t height;
+		int32_t channels;
+		int32_t info_width;
+		int32_t info_height;
+		uint32_t info_bpp;
+		uint32_t info_alpha;
+		uint32_t key_length;
+	};
+
+	struct Entry {
+		std::wstring filename;
+		uint64_t time;
+		uint64_t size;
+	};
+
+	uint64_t join(DWORD high, DWORD low)
+	{
+		return (static_cast<uint64_t>(high) << 32) | low;
+	}
+
+} // namespace
+
+DIP::ThumbCache::ThumbCache(const std::wstring &directory, size_t budget) :
+	m_directory(directory), m_budget(budget)
+{
+	while (m_directory.empty() == false && (m_directory.back() == L'\\' || m_directory.back() == L'/')) {
+		m_directory.pop_back();
+	}
+}
+
+bool DIP::ThumbCache::isValid() const
+{
+	return m_directory.empty() == false && m_budget > 0;
+}
+
+const std::wstring &DIP::ThumbCache::directory() const
+{
+	return m_directory;
+}
+
+size_t DIP::ThumbCache::budget() const
+{
+	return m_budget;
+}
+
+bool DIP::ThumbCache::stamp(const std::wstring &filename, Stamp &stamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesExW(filename.data(), GetFileExInfoStandard, &data) == 0) {
+		return false;
+	}
+	stamp.size = join(data.nFileSizeHigh, data.nFileSizeLow);
+	stamp.time = join(data.ftLastWriteTime.dwHighDateTime, data.ftLastWriteTime.dwLowDateTime);
+	return true;
+}
+
+std::wstring DIP::ThumbCache::key(const std::wstring &filename, const std::wstring &settings)
+{
+	std::wstring key = filename;
+	std::transform(key.begin(), key.end(), key.begin(), ::towlower);
+	return key + L"|" + settings;
+}
+
+std::wstring DIP::ThumbCache::entryFilename(const std::wstring &key) const
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (wchar_t symbol : key) {
+		hash = (hash ^ static_cast<uint64_t>(symbol)) * 1099511628211ULL;
+	}
+
+	wchar_t name[17];
+	swprintf_s(name, ARRAYSIZE(name), L"%016llx", static_cast<unsigned long long>(hash));
+	return m_directory + L"\\" + name + L"." + EXTENSION;
+}
+
+DIP::Image *DIP::ThumbCache::load(const std::wstring &filename, const std::wstring &settings, DIP::ImageInfo &info)
+{
+	Stamp current;
+	if (this->isValid() == false || stamp(filename, current) == false) {
+		return nullptr;
+	}
+
+	std::wstring key = DIP::ThumbCache::key(filename, settings);
+	std::wstring entry = this->entryFilename(key);
+
+	DIP::Image *image = nullptr;
+	{
+		DIP::MappedFile file(entry.data());
+		if (file.isValid() == false || file.size() < sizeof(Header)) {
+			return nullptr;
+		}
+
+		Header header;
+		memcpy(&header, file.data(), sizeof(Header));
+
+		if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+			return nullptr;
+		}
+		// the image has been changed since the thumbnail was stored
+		if (header.size != current.size || header.time != current.time) {
+			return nullptr;
+		}
+		if (header.width <= 0 || header.height <= 0 || (header.channels != 1 && header.channels != 3 && header.channels != 4)) {
+			return nullptr;
+		}
+
+		size_t key_size = static_cast<size_t>(header.key_length) * sizeof(wchar_t);
+		uint64_t pixels_size = static_cast<uint64_t>(header.width) * header.height * header.channels;
+		if (file.size() != sizeof(Header) + key_size + pixels_size) {
+			return nullptr;
+		}
+		// the other path with the same hash
+		if (header.key_length != key.size() || memcmp(file.data() + sizeof(Header), key.data(), key_size) != 0) {
+			return nullptr;
+		}
+
+		image = new DIP::Image(header.width, header.height, header.channels, file.data() + sizeof(Header) + key_size);
+
+		info.width = header.info_width;
+		info.height = header.info_height;
+		info.bpp = header.info_bpp;
+		info.alpha = header.info_alpha != 0;
+	}
+
+	if (image->isInitialized() == false) {
+		delete image;
+		return nullptr;
+	}
+
+	touch(entry);
+	return image;
+}
+
+void DIP::ThumbCache::store(const std::wstring &filename, const std::wstring &settings, const DIP::Image &thumb, const DIP::ImageInfo &info)
+{
+	int channels = thumb.channels();
+	Stamp current;
+	if (this->isValid() == false || channels == 0 || stamp(filename, current) == false) {
+		return;
+	}
+	if (this->prepare() == false) {
+		return;
+	}
+
+	std::wstring key = DIP::ThumbCache::key(filename, settings);
+	std::wstring entry = this->entryFilename(key);
+
+	Header header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.size = current.size;
+	header.time = current.time;
+	header.width = thumb.width();
+	header.height = thumb.height();
+	header.channels = channels;
+	header.info_width = info.width;
+	header.info_height = info.height;
+	header.info_bpp = info.bpp;
+	header.info_alpha = info.alpha ? 1 : 0;
+	header.key_length = static_cast<uint32_t>(key.size());
+
+	// written aside and moved in place, so the readers never see a partial entry
+	std::wstring temporary = entry + L"." + std::to_wstring(GetCurrentThreadId());
+
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, temporary.data(), L"wb") != 0 || file == nullptr) {
+		return;
+	}
+
+	size_t length = static_cast<size_t>(header.width) * channels;
+	bool written = fwrite(&header, sizeof(Header), 1, file) == 1 && fwrite(key.data(), sizeof(wchar_t), key.size(), file) == key.size();
+	for (int line = 0; written && line < header.height; ++line) {
+		written = fwrite(thumb.row(line), 1, length, file) == length;
+	}
+	written = fclose(file) == 0 && written;
+
+	int64_t size = static_cast<int64_t>(sizeof(Header) + key.size() * sizeof(wchar_t) + length * header.height);
+
+	WIN32_FILE_ATTRIBUTE_DATA previous;
+	if (GetFileAttributesExW(entry.data(), GetFileExInfoStandard, &previous)) {
+		size -= static_cast<int64_t>(join(previous.nFileSizeHigh, previous.nFileSizeLow));
+	}
+
+	if (written == false || MoveFileExW(temporary.data(), entry.data(), MOVEFILE_REPLACE_EXISTING) == 0) {
+		Log.error(L"Thumbnail cannot be stored | filename = %s", entry.data());
+		DeleteFileW(temporary.data());
+		return;
+	}
+
+	this->account(size);
+}
+
+void DIP::ThumbCache::touch(const std::wstring &entry)
+{
+	HANDLE file = CreateFileW(entry.data(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	// the last access time is not updated by the most systems, so the modification time is used instead
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, nullptr, nullptr, &now);
+	CloseHandle(file);
+}
+
+bool DIP::ThumbCache::prepare()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_prepared) {
+		return m_writable;
+	}
+	m_prepared = true;
+
+	if (CreateDirectoryW(m_directory.data(), nullptr) == 0 && GetLastError() != ERROR_ALREADY_EXISTS) {
+		Log.error(L"Thumbnail cache directory cannot be created | directory = %s", m_directory.data());
+		return false;
+	}
+	m_writable = true;
+
+	DIP::FileIterator iterator(m_directory.data(), {EXTENSION});
+	if (iterator.isValid()) {
+		do {
+			m_used += join(iterator.value().nFileSizeHigh, iterator.value().nFileSizeLow);
+		} while (iterator.next());
+	}
+
+	Log.debug(L"Thumbnail cache is opened | directory = %s | size = %llu", m_directory.data(), static_cast<unsigned long long>(m_used));
+	return true;
+}
+
+void DIP::ThumbCache::account(int64_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_used = (size < 0 && static_cast<uint64_t>(-size) > m_used) ? 0 : m_used + size;
+	if (m_used > m_budget) {
+		this->evict();
+	}
+}
+
+void DIP::ThumbCache::evict()
+{
+	std::vector<Entry> entries;
+	uint64_t used = 0;
+
+	DIP::FileIterator iterator(m_directory.data(), {EXTENSION});
+	if (iterator.isValid()) {
+		do {
+			const WIN32_FIND_DATA &data = iterator.value();
+			Entry entry;
+			entry.filename = iterator.fullFilename();
+			entry.time = join(data.ftLastWriteTime.dwHighDateTime, data.ftLastWriteTime.dwLowDateTime);
+			entry.size = join(data.nFileSizeHigh, data.nFileSizeLow);
+			used += entry.size;
+			entries.push_back(entry);
+		} while (iterator.next());
+	}
+
+	std::sort(entries.begin(), entries.end(), [] (const Entry &a, const Entry &b) {
+		return a.time < b.time;
+	});
+
+	// a quarter of the budget is freed at once, so the directory is not scanned on every store
+	uint64_t target = m_budget - m_budget / 4;
+	size_t removed = 0;
+	for (const Entry &entry : entries) {
+		if (used <= target) {
+			break;
+		}
+		if (DeleteFileW(entry.filename.data())) {
+			used -= entry.size;
+			++removed;
+		}
+	}
+
+	m_used = used;
+	Log.info(L"Thumbnail cache has been trimmed | removed = %u | size = %llu", static_cast<unsigned int>(removed), static_cast<unsigned long long>(used));
+}
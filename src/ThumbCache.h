@@ -0,0 +1,67 @@
+#ifndef DIP_THUMBCACHE_H
+#define DIP_THUMBCACHE_H
+
+#include "Image.h"
+
+#include <string>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+namespace DIP {
+
+	// the thumbnails stored on the disk between the sessions, one file per thumbnail: its name is made of the image
+	// path and the rendering settings, the size and the modification time of the image are checked on reading;
+	// the least recently used files are removed when the directory outgrows the budget
+	class ThumbCache
+	{
+	public:
+		// the budget is in bytes
+		ThumbCache(const std::wstring &directory, size_t budget);
+
+		ThumbCache(const ThumbCache&) = delete;
+		ThumbCache& operator=(const ThumbCache&) = delete;
+
+		bool isValid() const;
+
+		const std::wstring &directory() const;
+		size_t budget() const;
+
+		// returns nullptr when there is no thumbnail for the current version of the file
+		DIP::Image *load(const std::wstring &filename, const std::wstring &settings, DIP::ImageInfo &info);
+		// the images of the formats other than gray, BGR and BGRA are not stored
+		void store(const std::wstring &filename, const std::wstring &settings, const DIP::Image &thumb, const DIP::ImageInfo &info);
+
+		// the identity of the version of the image file
+		struct Stamp {
+			uint64_t size = 0;
+			uint64_t time = 0;
+		};
+
+		static bool stamp(const std::wstring &filename, Stamp &stamp);
+		// the key is the lowercased path and the settings, the name of the entry is its hash
+		static std::wstring key(const std::wstring &filename, const std::wstring &settings);
+
+	private:
+		std::wstring entryFilename(const std::wstring &key) const;
+
+		// marks the entry as used, the eviction goes by the modification times
+		static void touch(const std::wstring &entry);
+		// creates the directory and counts the entries on the first call
+		bool prepare();
+		// the size is the change of the total size of the entries, the oldest ones are evicted when the budget is exceeded
+		void account(int64_t size);
+		void evict();
+
+		std::wstring m_directory;
+		size_t m_budget;
+
+		std::mutex m_mutex;
+		bool m_prepared = false;
+		bool m_writable = false;
+		uint64_t m_used = 0;
+	};
+
+} // namespace DIP
+
+#endif // DIP_THUMBCACHE_H
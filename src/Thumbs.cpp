@@ -1,9 +1,7 @@
 #include "Thumbs.h"
 
-#include "Image.h"
 #include "Logger.h"
 
-#include <thread>
 #include <cmath>
 #include <algorithm>
 
@@ -96,8 +94,40 @@ std::wstring DIP::Thumbs::filename(int index) const
 
 DIP::Image *DIP::Thumbs::image(int index) const
 {
-	index -= this->offset();
-	return (index >= 0 && index < static_cast<int>(m_images.size())) ? m_images.at(index) : nullptr;
+	std::shared_ptr<Page> page = m_page;
+	if (page == nullptr) {
+		return nullptr;
+	}
+	index -= page->offset;
+	std::lock_guard<std::mutex> lock(page->mutex);
+	return (index >= 0 && index < static_cast<int>(page->images.size())) ? page->images.at(index).get() : nullptr;
+}
+
+bool DIP::Thumbs::info(int index, DIP::ImageInfo &info) const
+{
+	std::shared_ptr<Page> page = m_page;
+	if (page == nullptr) {
+		return false;
+	}
+	index -= page->offset;
+	std::lock_guard<std::mutex> lock(page->mutex);
+	if (index < 0 || index >= static_cast<int>(page->infos.size()) || page->infos.at(index).width <= 0) {
+		return false;
+	}
+	info = page->infos.at(index);
+	return true;
+}
+
+bool DIP::Thumbs::cellRect(int index, RECT &rect) const
+{
+	if (index < 0 || m_current_cols <= 0 || index >= this->thumbsCountOnPage()) {
+		return false;
+	}
+	rect.left = (index % m_current_cols) * (m_thumb_width + m_pad_h);
+	rect.top = (index / m_current_cols) * (m_thumb_height + m_pad_v);
+	rect.right = rect.left + m_thumb_width;
+	rect.bottom = rect.top + m_thumb_height;
+	return true;
 }
 
 std::wstring DIP::Thumbs::path() const
@@ -148,6 +178,112 @@ void DIP::Thumbs::setShift(int shift)
 	}
 }
 
+bool DIP::Thumbs::isProbe() const
+{
+	return m_probe;
+}
+
+void DIP::Thumbs::setProbe(bool probe)
+{
+	m_probe = probe;
+}
+
+bool DIP::Thumbs::isKeepImages() const
+{
+	return m_keep_images;
+}
+
+void DIP::Thumbs::setKeepImages(bool keep_images)
+{
+	m_keep_images = keep_images;
+}
+
+HWND DIP::Thumbs::notifyWindow() const
+{
+	return m_window;
+}
+
+void DIP::Thumbs::setNotifyWindow(HWND window)
+{
+	m_window = window;
+}
+
+unsigned int DIP::Thumbs::prefetchDepth() const
+{
+	return m_prefetch_depth;
+}
+
+void DIP::Thumbs::setPrefetchDepth(unsigned int depth)
+{
+	m_prefetch_depth = depth;
+}
+
+bool DIP::Thumbs::isPrefetchPrevious() const
+{
+	return m_prefetch_previous;
+}
+
+void DIP::Thumbs::setPrefetchPrevious(bool previous)
+{
+	m_prefetch_previous = previous;
+}
+
+size_t DIP::Thumbs::prefetchMemory() const
+{
+	return m_prefetch_memory;
+}
+
+void DIP::Thumbs::setPrefetchMemory(size_t memory)
+{
+	m_prefetch_memory = memory;
+}
+
+bool DIP::Thumbs::isQuantize() const
+{
+	return m_quantize;
+}
+
+void DIP::Thumbs::setQuantize(bool quantize)
+{
+	if (m_quantize != quantize) {
+		m_quantize = quantize;
+		m_update_required = true;
+	}
+}
+
+std::shared_ptr<DIP::ThumbCache> DIP::Thumbs::cache() const
+{
+	return m_cache;
+}
+
+void DIP::Thumbs::setCache(const std::shared_ptr<DIP::ThumbCache> &cache)
+{
+	m_cache = cache;
+	m_reload_required = true;
+}
+
+std::shared_ptr<DIP::MemoryThumbCache> DIP::Thumbs::memoryCache() const
+{
+	return m_memory_cache;
+}
+
+void DIP::Thumbs::setMemoryCache(const std::shared_ptr<DIP::MemoryThumbCache> &cache)
+{
+	m_memory_cache = cache;
+	m_reload_required = true;
+}
+
+std::shared_ptr<DIP::XdgThumbCache> DIP::Thumbs::sharedCache() const
+{
+	return m_shared_cache;
+}
+
+void DIP::Thumbs::setSharedCache(const std::shared_ptr<DIP::XdgThumbCache> &cache)
+{
+	m_shared_cache = cache;
+	m_reload_required = true;
+}
+
 bool DIP::Thumbs::isEnlarge() const
 {
 	return m_enlarge;
@@ -155,74 +291,382 @@ bool DIP::Thumbs::isEnlarge() const
 
 void DIP::Thumbs::clear()
 {
-	for (auto image : m_images) {
-		delete image;
+	// the workers still holding the pages drop their work and release them on their own
+	if (m_page) {
+		cancel(*m_page);
+		m_page.reset();
+	}
+	for (const std::shared_ptr<Page> &page : m_prefetched) {
+		cancel(*page);
+	}
+	m_prefetched.clear();
+}
+
+void DIP::Thumbs::cancel(Page &page)
+{
+	page.window = nullptr;
+	page.cancelled = true;
+}
+
+void DIP::Thumbs::probeImage(std::shared_ptr<Page> page, size_t index)
+{
+	if (page->cancelled) {
+		return;
+	}
+
+	{
+		// the image decoded meanwhile has the info already
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->states[index] != STATE_LOADING) {
+			return;
+		}
 	}
-	m_images.clear();
-	for (auto thumb : m_thumbs) {
-		delete thumb;
+
+	DIP::ImageInfo info;
+	if (DIP::Image::probe(page->filenames.at(index).data(), info) == false) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->states[index] != STATE_LOADING) {
+			return;
+		}
+		page->infos[index] = info;
 	}
-	m_thumbs.clear();
+
+	notify(*page, index);
 }
 
-void DIP::Thumbs::loadImage(const std::wstring &filename, DIP::Thumbs *thumbs, size_t index)
+void DIP::Thumbs::loadImage(std::shared_ptr<Page> page, size_t index)
 {
-	if (index >= thumbs->m_images.size()) {
+	if (page->cancelled) {
 		return;
 	}
 
-	DIP::Image *image;
+	std::wstring filename;
+	Target target;
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		filename = page->filenames.at(index);
+		target = page->target;
+	}
+
+	// the thumbnail stored for the same settings before makes the decoding needless
+	DIP::ImageInfo cached_info;
+	std::shared_ptr<DIP::Image> cached = loadCached(*page, filename, target, cached_info);
+	if (cached) {
+		cached = fitThumb(cached, target);
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->target.generation == target.generation) {
+			store(*page, index, nullptr, cached);
+			page->infos[index] = cached_info;
+			page->states[index] = STATE_READY;
+		} else {
+			cached = nullptr;
+			target = page->target;
+		}
+	}
+	if (cached) {
+		Log.debug(L"Thumbnail has been read from the cache | filename = %s", filename.data());
+		notify(*page, index);
+		return;
+	}
+
+	std::shared_ptr<DIP::Image> image;
+	DIP::ImageInfo shared_info;
+	if (page->shared_cache) {
+		image.reset(page->shared_cache->load(filename, target.width, target.height, shared_info));
+	}
+	bool shared = image != nullptr;
+
 	try {
-		image = new DIP::Image(filename.data());
+		if (shared == false) {
+			std::pair<int, int> box = decodeSize(target);
+			image = std::make_shared<DIP::Image>(filename.data(), box.first, box.second, &page->cancelled);
+		}
 	} catch (const std::exception &exception) {
-		Log.error(L"Image load exception | %s", exception.what());
+		Log.error(L"Image load exception | %S", exception.what());
+	}
+
+	if (page->cancelled) {
+		Log.debug(L"Image loading has been cancelled | filename = %s", filename.data());
 		return;
 	}
 
-	if (image->isInitialized() == 0) {
+	if (image == nullptr || image->isInitialized() == false) {
 		Log.info(L"Image cannot been loaded, so skipped | filename = %s", filename.data());
-		delete image;
+		{
+			std::lock_guard<std::mutex> lock(page->mutex);
+			page->states[index] = STATE_FAILED;
+		}
+		notify(*page, index);
 		return;
 	}
 
-	Log.debug(L"Image has been loaded | filename = %s", filename.data());
+	if (shared) {
+		Log.debug(L"Shared thumbnail has been loaded | filename = %s", filename.data());
+	} else {
+		Log.debug(L"Image has been loaded | filename = %s", filename.data());
+		if (page->shared_cache && page->shared_cache->isWritable()) {
+			page->shared_cache->store(filename, *image, target.width, target.height);
+		}
+	}
+
+	// taken before the image can be blended in place
+	DIP::ImageInfo info = shared ? shared_info : image->info();
+
+	while (true) {
+		std::shared_ptr<DIP::Image> thumb = page->direct ? nullptr : renderThumb(*page, image, filename, target, info);
 
-	thumbs->m_images[index] = image;
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->target.generation == target.generation) {
+			store(*page, index, image, thumb);
+			page->infos[index] = info;
+			page->states[index] = STATE_READY;
+			break;
+		}
+		// the target has been changed during the loading, the updates skip the images not loaded yet
+		target = page->target;
+	}
 
-	updateThumb(thumbs, index);
+	notify(*page, index);
 }
 
-void DIP::Thumbs::updateThumb(DIP::Thumbs *thumbs, size_t index)
+void DIP::Thumbs::updateThumb(std::shared_ptr<Page> page, size_t index, const Target &target)
 {
-	if (index >= thumbs->m_images.size() || index >= thumbs->m_thumbs.size()) {
+	if (page->cancelled) {
 		return;
 	}
 
-	DIP::Image *image = thumbs->m_images.at(index);
-	if (image == nullptr) {
-		return;
+	std::shared_ptr<DIP::Image> image;
+	std::wstring filename;
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->target.generation != target.generation) {
+			return;
+		}
+		// the images still loading catch up with the target on their own
+		if (page->states.at(index) != STATE_READY) {
+			return;
+		}
+		image = page->images.at(index);
+		filename = page->filenames.at(index);
 	}
 
-	DIP::Image *&thumb = thumbs->m_thumbs[index];
+	// the cached thumbnail is cheaper than scaling the image again
+	DIP::ImageInfo info;
+	std::shared_ptr<DIP::Image> thumb = loadCached(*page, filename, target, info);
 
 	if (thumb) {
-		delete thumb;
-		thumb = nullptr;
+		thumb = fitThumb(thumb, target);
+	} else {
+		if (image == nullptr) {
+			// the image has been released after scaling
+			std::pair<int, int> box = decodeSize(target);
+			image = std::make_shared<DIP::Image>(filename.data(), box.first, box.second, &page->cancelled);
+			if (page->cancelled || image->isInitialized() == false) {
+				return;
+			}
+			Log.debug(L"Image has been reloaded | filename = %s", filename.data());
+		} else if (page->keep_images) {
+			// the kept image is rescaled on every resize, so the chain is built on the first of them,
+			// the images never resized do not pay for it
+			image->buildMipmaps();
+		}
+		thumb = renderThumb(*page, image, filename, target, image->info());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->target.generation != target.generation) {
+			return;
+		}
+		store(*page, index, image, thumb);
 	}
 
-	if (thumbs->m_enlarge || image->width() > thumbs->m_thumb_width || image->height() > thumbs->m_thumb_height) {
-		thumb = image->inscribed(lround(thumbs->m_thumb_width), lround(thumbs->m_thumb_height));
+	notify(*page, index);
+}
+
+std::shared_ptr<DIP::Image> DIP::Thumbs::renderThumb(const Page &page, std::shared_ptr<DIP::Image> &image, const std::wstring &filename, const Target &target, const DIP::ImageInfo &info)
+{
+	std::shared_ptr<DIP::Image> thumb = makeThumb(page, image, filename, target);
+	storeCached(page, filename, target, thumb ? *thumb : *image, info);
+
+	thumb = fitThumb(thumb ? thumb : image, target);
+	// the image is drawn as is
+	return thumb == image ? nullptr : thumb;
+}
+
+std::shared_ptr<DIP::Image> DIP::Thumbs::makeThumb(const Page &page, std::shared_ptr<DIP::Image> &image, const std::wstring &filename, const Target &target)
+{
+	if (image->covers(target.width, target.height) == false) {
+		// the cell has outgrown the reduced image, so decode it again
+		std::pair<int, int> box = decodeSize(target);
+		std::shared_ptr<DIP::Image> reloaded = std::make_shared<DIP::Image>(filename.data(), box.first, box.second, &page.cancelled);
+		if (reloaded->isInitialized()) {
+			Log.debug(L"Image has been reloaded | filename = %s", filename.data());
+			image = reloaded;
+		}
+	}
+
+	std::pair<int, int> size = thumbSize(*image, target);
+	DIP::Compositor compositor = thumbCompositor(target);
+
+	// the turned images always get the thumbnails
+	if (image->orientation() == 1 && size.first == image->width() && size.second == image->height()) {
+		if (image->isOpaque()) {
+			return nullptr;
+		}
+		// the image that is not kept becomes the thumbnail, so it is blended in place
+		if (page.keep_images == false && image->composite(compositor)) {
+			return nullptr;
+		}
+		std::shared_ptr<DIP::Image> thumb(image->composited(compositor));
+		if (thumb->isInitialized()) {
+			return thumb;
+		}
 	}
 
-	if (thumbs->m_transparency_grid && image->hasAlpha()) {
+	// the scaling and the compositing are done in one pass
+	return std::shared_ptr<DIP::Image>(image->scaled(size.first, size.second, target.filter, compositor));
+}
+
+std::shared_ptr<DIP::Image> DIP::Thumbs::loadCached(const Page &page, const std::wstring &filename, const Target &target, DIP::ImageInfo &info)
+{
+	std::wstring settings = cacheSettings(target);
+	if (page.memory_cache) {
+		std::shared_ptr<DIP::Image> thumb(page.memory_cache->load(filename, settings, info));
 		if (thumb) {
-			DIP::Image *temp = thumb;
-			thumb = temp->composited();
-			delete temp;
-		} else {
-			thumb = image->composited();
+			return thumb;
 		}
 	}
+
+	if (page.cache == nullptr) {
+		return nullptr;
+	}
+	std::shared_ptr<DIP::Image> thumb(page.cache->load(filename, settings, info));
+	// the next lookups do not touch the disk
+	if (thumb && page.memory_cache) {
+		page.memory_cache->store(filename, settings, *thumb, info);
+	}
+	return thumb;
+}
+
+void DIP::Thumbs::storeCached(const Page &page, const std::wstring &filename, const Target &target, const DIP::Image &thumb, const DIP::ImageInfo &info)
+{
+	if (page.cancelled) {
+		return;
+	}
+	std::wstring settings = cacheSettings(target);
+	if (page.memory_cache) {
+		page.memory_cache->store(filename, settings, thumb, info);
+	}
+	if (page.cache) {
+		page.cache->store(filename, settings, thumb, info);
+	}
+}
+
+std::wstring DIP::Thumbs::cacheSettings(const Target &target)
+{
+	// everything the pixels of the thumbnail depend on, except the image itself
+	wchar_t settings[64];
+	swprintf_s(settings, ARRAYSIZE(settings), L"%dx%d %d %d %02x%02x%02x %x", target.width, target.height, target.enlarge ? 1 : 0, target.transparency_grid ? 1 : 0,
+		target.background.rgbRed, target.background.rgbGreen, target.background.rgbBlue, target.filter);
+	return settings;
+}
+
+std::shared_ptr<DIP::Image> DIP::Thumbs::fitThumb(const std::shared_ptr<DIP::Image> &thumb, const Target &target)
+{
+	int width = thumb->width();
+	int height = thumb->height();
+	if (target.enlarge || width > target.cell_width || height > target.cell_height) {
+		std::pair<int, int> size = DIP::Image::inscribe(width, height, target.cell_width, target.cell_height);
+		width = size.first;
+		height = size.second;
+	}
+	if (width == thumb->width() && height == thumb->height()) {
+		return thumb;
+	}
+
+	// the quantized size is at most the square root of 2 larger, so the filter works on a small image
+	std::shared_ptr<DIP::Image> fitted(thumb->scaled(width, height, target.filter, thumbCompositor(target)));
+	return fitted && fitted->isInitialized() ? fitted : thumb;
+}
+
+int DIP::Thumbs::quantize(int size)
+{
+	double bucket = DIP_THUMBS_BUCKET_MIN;
+	while (lround(bucket) < size) {
+		bucket *= std::sqrt(2.0);
+	}
+	return lround(bucket);
+}
+
+std::pair<int, int> DIP::Thumbs::decodeSize(const Target &target)
+{
+	if (target.width <= 0 || target.height <= 0) {
+		return {target.width, target.height};
+	}
+	// the box is given in the oriented dimensions, as the thumbnail is, and the decoder takes the longest side of it
+	return {quantize(target.width + 1), quantize(target.height + 1)};
+}
+
+std::pair<int, int> DIP::Thumbs::thumbSize(const DIP::Image &image, const Target &target)
+{
+	// the turned image is fitted by its sides as it is shown
+	if (target.enlarge || image.orientedWidth() > target.width || image.orientedHeight() > target.height) {
+		return image.inscribe(target.width, target.height);
+	}
+	return {image.orientedWidth(), image.orientedHeight()};
+}
+
+DIP::Compositor DIP::Thumbs::thumbCompositor(const Target &target)
+{
+	if (target.transparency_grid) {
+		return DIP::Compositor(DIP::Compositor::MODE_CHECKERBOARD);
+	}
+	return DIP::Compositor(DIP::Compositor::MODE_COLOR, target.background.rgbRed, target.background.rgbGreen, target.background.rgbBlue);
+}
+
+void DIP::Thumbs::store(Page &page, size_t index, const std::shared_ptr<DIP::Image> &image, const std::shared_ptr<DIP::Image> &thumb)
+{
+	if (page.keep_images) {
+		page.images[index] = image;
+		page.thumbs[index] = thumb;
+	} else {
+		// the image drawn as is becomes the thumbnail itself
+		page.images[index] = nullptr;
+		page.thumbs[index] = thumb ? thumb : image;
+	}
+	limit(page);
+}
+
+void DIP::Thumbs::notify(const Page &page, size_t index)
+{
+	if (page.window) {
+		PostMessage(page.window, DIP_WM_THUMB_READY, index, 0);
+	}
+}
+
+DIP::Thumbs::Target DIP::Thumbs::target(unsigned int generation) const
+{
+	return this->target(generation, m_thumb_width, m_thumb_height);
+}
+
+DIP::Thumbs::Target DIP::Thumbs::target(unsigned int generation, int cell_width, int cell_height) const
+{
+	Target target;
+	target.generation = generation;
+	target.cell_width = cell_width;
+	target.cell_height = cell_height;
+	target.width = m_quantize && cell_width > 0 ? quantize(cell_width) : cell_width;
+	target.height = m_quantize && cell_height > 0 ? quantize(cell_height) : cell_height;
+	target.enlarge = m_enlarge;
+	target.transparency_grid = m_transparency_grid;
+	target.background = m_background;
+	target.filter = m_filter | (m_auto_filter ? DIP_IMAGE_FILTER_AUTO : 0);
+	return target;
 }
 
 void DIP::Thumbs::reload()
@@ -232,35 +676,279 @@ void DIP::Thumbs::reload()
 		return;
 	}
 
-	this->clear();
-
-	int count =this->thumbsCountOnPage();
+	int count = this->thumbsCountOnPage();
 
 	if (count == 0) {
+		this->clear();
 		m_reload_required = false;
 		return;
 	}
 
-	m_images.assign(count, nullptr);
-	m_thumbs.assign(count, nullptr);
-
 	if (m_adaptive) {
 		this->recalculateThumbs();
 	}
 
-	std::vector<std::thread> threads;
-	threads.reserve(count);
+	int offset = this->offset();
 
-	for (int i = 0; i < count; ++i) {
-		std::wstring filename = m_path + m_files[this->offset() + i];
-		threads.push_back(std::thread(loadImage, filename, this, i));
+	std::shared_ptr<Page> page;
+	for (auto it = m_prefetched.begin(); it != m_prefetched.end(); ++it) {
+		// the page cancelled for its memory has lost some of the images
+		if ((*it)->offset == offset && (*it)->filenames.size() == static_cast<size_t>(count) && (*it)->cancelled == false) {
+			page = *it;
+			m_prefetched.erase(it);
+			break;
+		}
 	}
 
-	for (int i = 0; i < count; ++i) {
-		threads.at(i).join();
+	// the page left behind may be a neighbour of the new one
+	if (m_page && m_page != page) {
+		if (m_prefetch_depth) {
+			m_page->window = nullptr;
+			m_prefetched.push_back(m_page);
+		} else {
+			cancel(*m_page);
+		}
+	}
+
+	if (page) {
+		Log.debug(L"Prefetched page is used | offset = %d", offset);
+		{
+			// the full images dropped for the budget are not loaded again, the thumbnails are enough to show the page
+			std::lock_guard<std::mutex> lock(page->mutex);
+			page->budget = 0;
+		}
+		m_page = page;
+		m_page->window = m_window;
+		this->retarget(page);
+	} else {
+		page = this->createPage(offset, count, this->target(0));
+		page->window = m_window;
+		page->probe = m_probe;
+
+		m_page = page;
+		this->startPage(page, DIP::ThreadPool::PRIORITY_NORMAL);
 	}
 
 	m_reload_required = false;
+
+	if (m_window == nullptr) {
+		this->wait();
+	} else {
+		this->prefetch();
+	}
+}
+
+std::shared_ptr<DIP::Thumbs::Page> DIP::Thumbs::createPage(int offset, int count, const Target &target) const
+{
+	std::shared_ptr<Page> page = std::make_shared<Page>();
+	page->offset = offset;
+	page->filenames.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		page->filenames.push_back(m_path + m_files[offset + i]);
+	}
+	page->images.assign(count, nullptr);
+	page->thumbs.assign(count, nullptr);
+	page->infos.assign(count, DIP::ImageInfo());
+	page->states.assign(count, STATE_LOADING);
+	page->target = target;
+	page->cache = m_cache;
+	page->memory_cache = m_memory_cache;
+	page->shared_cache = m_shared_cache;
+	// the canvas is drawn once, straight from the images, unless the thumbnails are fitted into the cells,
+	// the cells drawn so are stored in the caches as the thumbnails
+	page->direct = m_window == nullptr && target.width == target.cell_width && target.height == target.cell_height;
+	page->keep_images = m_keep_images || page->direct;
+	return page;
+}
+
+void DIP::Thumbs::startPage(const std::shared_ptr<Page> &page, DIP::ThreadPool::Priority priority) const
+{
+	DIP::ThreadPool &pool = DIP::ThreadPool::instance();
+
+	// the headers are read by the workers ahead of the decoding, each frame appears as soon as its header is read,
+	// the decoding does not wait for the whole page and the window is not blocked by the slow folders
+	if (page->probe) {
+		for (size_t i = 0; i < page->filenames.size(); ++i) {
+			pool.submit(page->group, [page, i] {
+				probeImage(page, i);
+			}, priority == DIP::ThreadPool::PRIORITY_LOW ? priority : DIP::ThreadPool::PRIORITY_HIGH);
+		}
+	}
+
+	for (size_t i = 0; i < page->filenames.size(); ++i) {
+		pool.submit(page->group, [page, i] {
+			loadImage(page, i);
+		}, priority);
+	}
+}
+
+void DIP::Thumbs::retarget(const std::shared_ptr<Page> &page) const
+{
+	Target target;
+	size_t size;
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		if (page->target.sameAs(this->target(0))) {
+			return;
+		}
+		// the thumbnails for the previous target are dropped as soon as they are ready
+		target = this->target(page->target.generation + 1);
+		page->target = target;
+		size = page->images.size();
+	}
+
+	DIP::ThreadPool &pool = DIP::ThreadPool::instance();
+
+	for (size_t i = 0; i < size; ++i) {
+		pool.submit(page->group, [page, i, target] {
+			updateThumb(page, i, target);
+		});
+	}
+}
+
+void DIP::Thumbs::prefetch()
+{
+	// the offsets of the neighbour pages, the nearest first
+	std::vector<int> offsets;
+	int size = this->pageSize();
+	for (int i = 1; i <= static_cast<int>(m_prefetch_depth); ++i) {
+		if (m_offset + i * size < this->count() - m_shift) {
+			offsets.push_back(m_offset + i * size + m_shift);
+		}
+		if (m_prefetch_previous && m_offset - i * size >= 0) {
+			offsets.push_back(m_offset - i * size + m_shift);
+		}
+	}
+
+	// the images of the neighbour pages are expected to be like the ones of the current page,
+	// the decoded size is taken by the source size, as the formats without reduced decoding have it
+	size_t image_memory = 0;
+	if (m_page) {
+		std::lock_guard<std::mutex> lock(m_page->mutex);
+		size_t known = 0;
+		for (const DIP::ImageInfo &info : m_page->infos) {
+			if (info.width > 0 && info.height > 0) {
+				image_memory += static_cast<size_t>(info.width) * info.height * 4;
+				++known;
+			}
+		}
+		image_memory = known ? image_memory / known : 0;
+	}
+
+	std::vector<std::shared_ptr<Page>> prefetched;
+	size_t memory = 0;
+
+	for (int offset : offsets) {
+		int count = min(size, this->count() - offset);
+
+		std::shared_ptr<Page> page;
+		for (const std::shared_ptr<Page> &candidate : m_prefetched) {
+			if (candidate->offset == offset && candidate->filenames.size() == static_cast<size_t>(count) && candidate->cancelled == false) {
+				page = candidate;
+				break;
+			}
+		}
+
+		bool created = page == nullptr;
+		if (created) {
+			int cols = 0;
+			int rows = 0;
+			int thumb_width = 0;
+			int thumb_height = 0;
+			this->layout(count, cols, rows, thumb_width, thumb_height);
+			page = this->createPage(offset, count, this->target(0, thumb_width, thumb_height));
+		}
+
+		size_t estimate = pageMemory(*page, page->keep_images, image_memory);
+		// the full images are given up first, the thumbnails alone take much less
+		if (m_prefetch_memory && memory + estimate > m_prefetch_memory && page->keep_images) {
+			estimate = pageMemory(*page, false, image_memory);
+		}
+		if (m_prefetch_memory && memory + estimate > m_prefetch_memory) {
+			break;
+		}
+		memory += estimate;
+
+		{
+			// the estimate becomes the budget, every stored image is checked against it
+			std::lock_guard<std::mutex> lock(page->mutex);
+			page->budget = m_prefetch_memory ? estimate : 0;
+			limit(*page);
+		}
+
+		if (created) {
+			this->startPage(page, DIP::ThreadPool::PRIORITY_LOW);
+		}
+		prefetched.push_back(page);
+	}
+
+	// the rest of the pages are dropped
+	for (const std::shared_ptr<Page> &page : m_prefetched) {
+		if (std::find(prefetched.begin(), prefetched.end(), page) == prefetched.end()) {
+			cancel(*page);
+		}
+	}
+	m_prefetched.swap(prefetched);
+}
+
+size_t DIP::Thumbs::pageMemory(Page &page, bool keep_images, size_t image_memory)
+{
+	std::lock_guard<std::mutex> lock(page.mutex);
+	size_t thumb_memory = static_cast<size_t>(page.target.width) * page.target.height * 4;
+	size_t memory = 0;
+	for (size_t i = 0; i < page.images.size(); ++i) {
+		if (page.states[i] == STATE_LOADING) {
+			const DIP::ImageInfo &info = page.infos[i];
+			size_t probed = info.width > 0 && info.height > 0 ? static_cast<size_t>(info.width) * info.height * 4 : image_memory;
+			memory += thumb_memory + (keep_images ? probed : 0);
+			continue;
+		}
+		// the image drawn as is stays as the thumbnail
+		if (page.images[i] && (keep_images || page.thumbs[i] == nullptr)) {
+			memory += page.images[i]->memorySize();
+		}
+		memory += page.thumbs[i] ? page.thumbs[i]->memorySize() : 0;
+	}
+	return memory;
+}
+
+void DIP::Thumbs::limit(Page &page)
+{
+	if (page.budget == 0 || page.cancelled) {
+		return;
+	}
+
+	auto memory = [&page] {
+		size_t memory = 0;
+		for (size_t i = 0; i < page.images.size(); ++i) {
+			memory += page.images[i] ? page.images[i]->memorySize() : 0;
+			memory += page.thumbs[i] ? page.thumbs[i]->memorySize() : 0;
+		}
+		return memory;
+	};
+
+	if (memory() <= page.budget) {
+		return;
+	}
+
+	if (page.keep_images) {
+		Log.debug(L"Prefetched page keeps the thumbnails only | offset = %d", page.offset);
+		page.keep_images = false;
+		for (size_t i = 0; i < page.images.size(); ++i) {
+			// the image drawn as is becomes the thumbnail itself
+			if (page.images[i] && page.thumbs[i] == nullptr) {
+				page.thumbs[i] = page.images[i];
+			}
+			page.images[i] = nullptr;
+		}
+		if (memory() <= page.budget) {
+			return;
+		}
+	}
+
+	// the rest of the images would not fit either
+	Log.debug(L"Prefetched page is over the memory limit, so cancelled | offset = %d", page.offset);
+	cancel(page);
 }
 
 void DIP::Thumbs::update()
@@ -272,26 +960,34 @@ void DIP::Thumbs::update()
 		return;
 	}
 
-	if (m_reload_required || this->isLoaded() == false) {
+	if (m_reload_required || m_page == nullptr) {
 		this->reload();
 		m_update_required = false;
 		return;
 	}
 
-	size_t size = m_images.size();
+	this->retarget(m_page);
 
-	std::vector<std::thread> threads;
-	threads.reserve(size);
+	m_update_required = false;
 
-	for (size_t i = 0; i < size; ++i) {
-		threads.push_back(std::thread(updateThumb, this, i));
+	if (m_window == nullptr) {
+		this->wait();
 	}
+}
 
-	for (size_t i = 0; i < threads.size(); ++i) {
-		threads.at(i).join();
+bool DIP::Thumbs::wait(unsigned int timeout)
+{
+	std::shared_ptr<Page> page = m_page;
+	if (page == nullptr) {
+		return true;
 	}
 
-	m_update_required = false;
+	DIP::ThreadPool &pool = DIP::ThreadPool::instance();
+	if (timeout == INFINITE) {
+		pool.wait(page->group);
+		return true;
+	}
+	return pool.wait(page->group, timeout);
 }
 
 void DIP::Thumbs::setEnlarge(bool enlarge)
@@ -309,7 +1005,23 @@ int DIP::Thumbs::filter() const
 
 void DIP::Thumbs::setFilter(int filter)
 {
-	m_filter = filter;
+	if (m_filter != filter) {
+		m_filter = filter;
+		m_update_required = true;
+	}
+}
+
+bool DIP::Thumbs::isAutoFilter() const
+{
+	return m_auto_filter;
+}
+
+void DIP::Thumbs::setAutoFilter(bool auto_filter)
+{
+	if (m_auto_filter != auto_filter) {
+		m_auto_filter = auto_filter;
+		m_update_required = true;
+	}
 }
 
 bool DIP::Thumbs::isShowTransparencyGrid() const
@@ -354,6 +1066,10 @@ RGBQUAD DIP::Thumbs::background() const
 
 void DIP::Thumbs::setBackground(const RGBQUAD &background)
 {
+	if (m_background.rgbRed != background.rgbRed || m_background.rgbGreen != background.rgbGreen || m_background.rgbBlue != background.rgbBlue) {
+		// the transparent thumbnails are blended over the background
+		m_update_required = true;
+	}
 	m_background = background;
 }
 
@@ -364,7 +1080,7 @@ bool DIP::Thumbs::isEmpty() const
 
 bool DIP::Thumbs::isLoaded() const
 {
-	return m_images.size() != 0 || m_reload_required == false;
+	return m_page != nullptr || m_reload_required == false;
 }
 
 bool DIP::Thumbs::isUpdateRequired() const
@@ -493,32 +1209,70 @@ void DIP::Thumbs::recalculateThumbs()
 		return;
 	}
 
-	int count = this->thumbsCountOnPage();
+	this->layout(this->thumbsCountOnPage(), m_current_cols, m_current_rows, m_thumb_width, m_thumb_height);
+
+	//m_thumb_aspect_ratio = m_thumb_height > 0 ? static_cast<float>(m_thumb_width) / m_thumb_height : 0;
+
+	m_update_required = true;
+}
 
+void DIP::Thumbs::layout(int count, int &cols, int &rows, int &thumb_width, int &thumb_height) const
+{
 	if (m_adaptive && count < this->pageSize() && count && m_height) {
-		m_current_cols = lround(std::sqrt(static_cast<float>(m_width) / m_height * count));
-		if (m_current_cols == 0) {
-			m_current_cols = 1;
+		cols = lround(std::sqrt(static_cast<float>(m_width) / m_height * count));
+		if (cols == 0) {
+			cols = 1;
 		}
-		m_current_rows = lround(ceil(static_cast<float>(count) / m_current_cols));
+		rows = lround(ceil(static_cast<float>(count) / cols));
 	} else {
-		m_current_cols = m_cols;
-		m_current_rows = m_rows;
+		cols = m_cols;
+		rows = m_rows;
 	}
 
-	m_thumb_width = m_current_cols > 0 ? (m_width - (m_current_cols - 1) * m_pad_h) / m_current_cols : 0;
-	m_thumb_height = m_current_rows > 0 ? (m_height - (m_current_rows - 1) * m_pad_v) / m_current_rows : 0;
+	thumb_width = cols > 0 ? (m_width - (cols - 1) * m_pad_h) / cols : 0;
+	thumb_height = rows > 0 ? (m_height - (rows - 1) * m_pad_v) / rows : 0;
+}
 
-	//m_thumb_aspect_ratio = m_thumb_height > 0 ? static_cast<float>(m_thumb_width) / m_thumb_height : 0;
+HBITMAP DIP::Thumbs::bitmap()
+{
+	std::unique_ptr<DIP::Image> canvas(this->canvas());
+	return canvas->bitmap();
+}
 
-	m_update_required = true;
+DIP::Image *DIP::Thumbs::canvas()
+{
+	DIP::Image *canvas = new DIP::Image(m_width, m_height, m_background);
+	this->draw(*canvas, 0, 0);
+	return canvas;
 }
 
-HBITMAP DIP::Thumbs::bitmap()
+std::wstring DIP::Thumbs::canvasKey() const
 {
-	DIP::Image canvas(m_width, m_height, m_background);
-	this->draw(canvas, 0, 0);
-	return canvas.bitmap();
+	int count = this->thumbsCountOnPage();
+
+	// the layout the page gets once it is loaded
+	int cols = 0;
+	int rows = 0;
+	int thumb_width = 0;
+	int thumb_height = 0;
+	this->layout(count, cols, rows, thumb_width, thumb_height);
+	Target target = this->target(0, thumb_width, thumb_height);
+
+	wchar_t layout[64];
+	swprintf_s(layout, ARRAYSIZE(layout), L"%dx%d %dx%d %d %d ", m_width, m_height, cols, rows, m_pad_h, m_pad_v);
+	std::wstring key = layout + cacheSettings(target);
+
+	for (int i = 0; i < count; ++i) {
+		const std::wstring &file = m_files[this->offset() + i];
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		wchar_t stamp[64] = L"";
+		if (GetFileAttributesExW((m_path + file).data(), GetFileExInfoStandard, &data)) {
+			swprintf_s(stamp, ARRAYSIZE(stamp), L" %x%08x %x%08x", data.nFileSizeHigh, data.nFileSizeLow, data.ftLastWriteTime.dwHighDateTime, data.ftLastWriteTime.dwLowDateTime);
+		}
+		key += L"|" + file + stamp;
+	}
+
+	return key;
 }
 
 void DIP::Thumbs::drawInfo(HDC hdc, RECT &rect) const
@@ -536,7 +1290,7 @@ void DIP::Thumbs::drawInfo(HDC hdc, RECT &rect) const
 	HFONT old_font = (HFONT) SelectObject(hdc, new_font);
 
 	WCHAR text[52];
-	if (m_images.size()) {
+	if (m_page) {
 		swprintf_s(text, ARRAYSIZE(text), L"%d / %d (%d - %d / %d)", this->currentPage() + 1, this->pagesCount(), this->offset() + 1, this->offset() + this->thumbsCountOnPage(), this->count());
 	} else {
 		swprintf_s(text, ARRAYSIZE(text), L"0 / 0 (0 - 0 / %d)", this->count());
@@ -552,25 +1306,34 @@ void DIP::Thumbs::draw(const T &destination, int x, int y)
 {
 	this->update();
 
+	std::shared_ptr<Page> page = m_page;
+	if (page == nullptr) {
+		return;
+	}
+
+	// the images are shared, so the workers are held up only while the cells are copied, not by the drawing
+	std::vector<Cell> cells;
+	Target target;
+	{
+		std::lock_guard<std::mutex> lock(page->mutex);
+		cells.resize(page->images.size());
+		for (size_t i = 0; i < cells.size(); ++i) {
+			cells[i].image = page->images.at(i);
+			cells[i].thumb = page->thumbs.at(i);
+			cells[i].info = page->infos.at(i);
+			cells[i].state = page->states.at(i);
+		}
+		target = page->target;
+	}
+
 	int tx = 0;
 	int ty = 0;
 
-	size_t size = m_images.size();
-
-	for (size_t i = 0; i < size; ++i) {
-		DIP::Image *thumb = m_thumbs.at(i);
-		if (thumb == nullptr) {
-			thumb = m_images.at(i);
-		}
-		if (thumb == nullptr) {
-			continue;
-		}
+	for (size_t i = 0; i < cells.size(); ++i) {
+		int cell_x = x + tx * (m_thumb_width + m_pad_h);
+		int cell_y = y + ty * (m_thumb_height + m_pad_v);
 
-		thumb->draw(
-			destination,
-			x + tx * (m_thumb_width + m_pad_h) + (m_thumb_width - thumb->width()) / 2,
-			y + ty * (m_thumb_height + m_pad_v) + (m_thumb_height - thumb->height()) / 2
-		);
+		this->drawCell(destination, *page, i, cells[i], target, cell_x, cell_y);
 
 		++tx;
 		if (tx >= m_current_cols) {
@@ -580,5 +1343,91 @@ void DIP::Thumbs::draw(const T &destination, int x, int y)
 	}
 }
 
+void DIP::Thumbs::drawCell(HDC hdc, const Page &page, size_t /*index*/, const Cell &cell, const Target &target, int x, int y) const
+{
+	const DIP::Image *thumb = cell.thumb ? cell.thumb.get() : cell.image.get();
+	if (thumb && page.direct) {
+		this->drawScaled(hdc, *thumb, x, y, target);
+	} else if (thumb) {
+		thumb->draw(hdc, x + (m_thumb_width - thumb->width()) / 2, y + (m_thumb_height - thumb->height()) / 2);
+	} else if (cell.state == STATE_LOADING) {
+		this->drawPlaceholder(hdc, x, y, cell.info);
+	}
+}
+
+void DIP::Thumbs::drawCell(const DIP::Image &canvas, const Page &page, size_t index, const Cell &cell, const Target &target, int x, int y) const
+{
+	const DIP::Image *thumb = cell.thumb ? cell.thumb.get() : cell.image.get();
+	if (thumb && page.direct) {
+		this->drawScaled(canvas, *thumb, x, y, target);
+		if (cell.thumb == nullptr) {
+			this->storeScaled(page, index, cell, target, canvas, x, y);
+		}
+	} else if (thumb) {
+		thumb->draw(canvas, x + (m_thumb_width - thumb->width()) / 2, y + (m_thumb_height - thumb->height()) / 2);
+	}
+}
+
+void DIP::Thumbs::drawScaled(HDC hdc, const DIP::Image &image, int x, int y, const Target &target) const
+{
+	// the device context can't be written in place, so a temporary thumbnail is made
+	std::pair<int, int> size = thumbSize(image, target);
+	std::unique_ptr<DIP::Image> thumb(image.scaled(size.first, size.second, target.filter, thumbCompositor(target)));
+	if (thumb) {
+		thumb->draw(hdc, x + (m_thumb_width - thumb->width()) / 2, y + (m_thumb_height - thumb->height()) / 2);
+	}
+}
+
+void DIP::Thumbs::drawScaled(const DIP::Image &canvas, const DIP::Image &image, int x, int y, const Target &target) const
+{
+	std::pair<int, int> size = thumbSize(image, target);
+	image.draw(canvas, x + (m_thumb_width - size.first) / 2, y + (m_thumb_height - size.second) / 2, size.first, size.second, target.filter, thumbCompositor(target));
+}
+
+void DIP::Thumbs::storeScaled(const Page &page, size_t index, const Cell &cell, const Target &target, const DIP::Image &canvas, int x, int y) const
+{
+	if (page.cache == nullptr && page.memory_cache == nullptr) {
+		return;
+	}
+
+	std::pair<int, int> size = thumbSize(*cell.image, target);
+	std::unique_ptr<DIP::Image> thumb(canvas.region(x + (m_thumb_width - size.first) / 2, y + (m_thumb_height - size.second) / 2, size.first, size.second));
+	if (thumb) {
+		// the cell scaled straight from the image into the canvas is cut out of it and stored in the caches
+		storeCached(page, page.filenames.at(index), target, *thumb, cell.info);
+	}
+}
+
+void DIP::Thumbs::drawPlaceholder(HDC hdc, int x, int y, const DIP::ImageInfo &info) const
+{
+	int width = m_thumb_width;
+	int height = m_thumb_height;
+
+	if (info.width > 0 && info.height > 0) {
+		// the probed image gets its future frame
+		if (m_enlarge || info.width > width || info.height > height) {
+			std::pair<int, int> size = DIP::Image::inscribe(info.width, info.height, width, height);
+			width = size.first;
+			height = size.second;
+		} else {
+			width = info.width;
+			height = info.height;
+		}
+	}
+
+	x += (m_thumb_width - width) / 2;
+	y += (m_thumb_height - height) / 2;
+
+	// a bit lighter or darker than the background
+	auto shade = [] (BYTE value) -> BYTE {
+		return value < 128 ? value + 32 : value - 32;
+	};
+
+	RECT rect = {x, y, x + width, y + height};
+	HBRUSH brush = CreateSolidBrush(RGB(shade(m_background.rgbRed), shade(m_background.rgbGreen), shade(m_background.rgbBlue)));
+	FillRect(hdc, &rect, brush);
+	DeleteObject(brush);
+}
+
 template void DIP::Thumbs::draw<HDC>(const HDC&, int x, int y);
 template void DIP::Thumbs::draw<DIP::Image>(const DIP::Image&, int x, int y);
\ No newline at end of file
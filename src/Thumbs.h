@@ -1,13 +1,25 @@
 #ifndef DIP_THUMBS_H
 #define DIP_THUMBS_H
 
+#include "Image.h"
+#include "ThreadPool.h"
+#include "ThumbCache.h"
+#include "MemoryThumbCache.h"
+#include "XdgThumbCache.h"
+
 #include <vector>
 #include <string>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <Windows.h>
 
-namespace DIP {
+// posted to the notify window when a thumbnail is ready, WPARAM is the index of the thumbnail on the page
+#define DIP_WM_THUMB_READY (WM_APP + 1)
+// the smallest of the quantized thumbnail sizes, the next ones grow by the factor of the square root of 2
+#define DIP_THUMBS_BUCKET_MIN 16
 
-	class Image;
+namespace DIP {
 
 	class Thumbs
 	{
@@ -34,6 +46,10 @@ namespace DIP {
 		int filter() const;
 		void setFilter(int filter);
 
+		// large reductions are done by the box filter first, the filter is applied to the intermediate image
+		bool isAutoFilter() const;
+		void setAutoFilter(bool auto_filter);
+
 		bool isShowTransparencyGrid() const;
 		void setShowTransparencyGrid(bool transparency_grid);
 
@@ -68,6 +84,11 @@ namespace DIP {
 		bool lastPage();
 
 		HBITMAP bitmap();
+		// the whole page drawn over the background
+		DIP::Image *canvas();
+		// describes everything the canvas depends on: the layout, the thumbnail settings, the names, sizes and
+		// modification times of the files on the page
+		std::wstring canvasKey() const;
 		template <typename T>
 		void draw(const T &destination, int x, int y);
 
@@ -76,6 +97,8 @@ namespace DIP {
 		std::vector<std::wstring> scan(const wchar_t *path, int files_limit) const;
 
 		void update();
+		// waits for the current page to be loaded, returns false if it is still loading after the timeout
+		bool wait(unsigned int timeout = INFINITE);
 
 		int indexAt(int x, int y) const;
 		std::wstring filenameAt(int x, int y) const;
@@ -83,6 +106,8 @@ namespace DIP {
 
 		std::wstring filename(int index) const;
 		DIP::Image * image(int index) const;
+		bool info(int index, DIP::ImageInfo &info) const;
+		bool cellRect(int index, RECT &rect) const;
 
 		std::wstring path() const;
 
@@ -98,6 +123,44 @@ namespace DIP {
 		int shift() const;
 		void setShift(int shift);
 
+		bool isProbe() const;
+		void setProbe(bool probe);
+
+		// when disabled, only the thumbnails and the image metadata are kept, the images are decoded again on resize
+		bool isKeepImages() const;
+		void setKeepImages(bool keep_images);
+
+		// when the window is set, pages are loaded in the background and the window is notified about each ready thumbnail
+		HWND notifyWindow() const;
+		void setNotifyWindow(HWND window);
+
+		// the number of the next pages loaded in the background (with the notify window only)
+		unsigned int prefetchDepth() const;
+		void setPrefetchDepth(unsigned int depth);
+
+		bool isPrefetchPrevious() const;
+		void setPrefetchPrevious(bool previous);
+
+		// the limit of the memory taken by the prefetched pages in bytes, 0 means no limit
+		size_t prefetchMemory() const;
+		void setPrefetchMemory(size_t memory);
+
+		// the thumbnails are rendered at the quantized sizes and fitted into the cells, so the cached ones survive resizes
+		bool isQuantize() const;
+		void setQuantize(bool quantize);
+
+		// the thumbnails are read from the cache instead of decoding the images and stored there after, nullptr disables it
+		std::shared_ptr<DIP::ThumbCache> cache() const;
+		void setCache(const std::shared_ptr<DIP::ThumbCache> &cache);
+
+		// the thumbnails kept in memory for the whole process, looked up before the cache on the disk, nullptr disables it
+		std::shared_ptr<DIP::MemoryThumbCache> memoryCache() const;
+		void setMemoryCache(const std::shared_ptr<DIP::MemoryThumbCache> &cache);
+
+		// the thumbnails of the file managers are decoded instead of the images if they are large enough
+		std::shared_ptr<DIP::XdgThumbCache> sharedCache() const;
+		void setSharedCache(const std::shared_ptr<DIP::XdgThumbCache> &cache);
+
 	private:
 		std::wstring m_path;
 		std::vector<std::wstring> m_files;
@@ -105,8 +168,8 @@ namespace DIP {
 		int m_cols;
 		int m_rows;
 
-		int m_current_cols;
-		int m_current_rows;
+		int m_current_cols = 0;
+		int m_current_rows = 0;
 
 		int m_width = 0;
 		int m_height = 0;
@@ -117,6 +180,7 @@ namespace DIP {
 
 		bool m_enlarge = false;
 		int m_filter = 0;
+		bool m_auto_filter = true;
 		bool m_transparency_grid = true;
 
 		int m_pad_h = 0;
@@ -132,8 +196,84 @@ namespace DIP {
 		RGBQUAD m_info_color = {0, 0, 0, 0};
 		unsigned int m_info_size = 16;
 
-		std::vector<DIP::Image *> m_images;
-		std::vector<DIP::Image *> m_thumbs;
+		// the parameters of the thumbnails, captured when the work is submitted
+		struct Target {
+			unsigned int generation = 0;
+			// the size the thumbnails are rendered at, the quantized size of the cell if enabled
+			int width = 0;
+			int height = 0;
+			int cell_width = 0;
+			int cell_height = 0;
+			bool enlarge = false;
+			bool transparency_grid = true;
+			// the transparent images are blended over it without the grid
+			RGBQUAD background = {0, 0, 0, 0};
+			int filter = DIP_IMAGE_FILTER_BOX;
+
+			bool sameAs(const Target &other) const
+			{
+				return width == other.width && height == other.height && cell_width == other.cell_width && cell_height == other.cell_height && enlarge == other.enlarge && transparency_grid == other.transparency_grid && filter == other.filter
+					&& background.rgbRed == other.background.rgbRed && background.rgbGreen == other.background.rgbGreen && background.rgbBlue == other.background.rgbBlue;
+			}
+		};
+
+		enum State : unsigned char {
+			STATE_LOADING,
+			STATE_READY,
+			STATE_FAILED
+		};
+
+		// the images of one page, shared with the workers that fill it, so it outlives the Thumbs if needed
+		struct Page {
+			int offset = 0;
+			std::vector<std::wstring> filenames;
+			std::vector<std::shared_ptr<DIP::Image>> images;
+			std::vector<std::shared_ptr<DIP::Image>> thumbs;
+			std::vector<DIP::ImageInfo> infos;
+			std::vector<State> states;
+			Target target;
+			// turned off when the prefetched page outgrows its budget, so it is read by the workers without the lock
+			std::atomic<bool> keep_images {true};
+			// the share of the prefetch memory in bytes, the full images are dropped when it is exceeded, 0 means no limit
+			size_t budget = 0;
+			// the headers are read first, so the placeholders get the frames of the images
+			bool probe = false;
+			// the images are scaled straight into the canvas, without the thumbnails
+			bool direct = false;
+			std::shared_ptr<DIP::ThumbCache> cache;
+			std::shared_ptr<DIP::MemoryThumbCache> memory_cache;
+			std::shared_ptr<DIP::XdgThumbCache> shared_cache;
+			std::atomic<HWND> window {nullptr};
+			// set when the page is dropped, the workers skip or cut short its remaining work
+			std::atomic<bool> cancelled {false};
+			std::mutex mutex;
+			DIP::ThreadPool::Group group;
+		};
+
+		// the cell of the page copied under its lock, so it is drawn (and stored) without holding the lock
+		struct Cell {
+			std::shared_ptr<DIP::Image> image;
+			std::shared_ptr<DIP::Image> thumb;
+			DIP::ImageInfo info;
+			State state = STATE_LOADING;
+		};
+
+		std::shared_ptr<Page> m_page;
+		// the neighbour pages, the nearest first
+		std::vector<std::shared_ptr<Page>> m_prefetched;
+
+		unsigned int m_prefetch_depth = 0;
+		bool m_prefetch_previous = false;
+		size_t m_prefetch_memory = 0;
+
+		std::shared_ptr<DIP::ThumbCache> m_cache;
+		std::shared_ptr<DIP::MemoryThumbCache> m_memory_cache;
+		std::shared_ptr<DIP::XdgThumbCache> m_shared_cache;
+
+		bool m_probe = false;
+		bool m_keep_images = true;
+		bool m_quantize = false;
+		HWND m_window = nullptr;
 
 		int m_offset = 0;
 		int m_shift = 0;
@@ -145,9 +285,51 @@ namespace DIP {
 		void clear();
 
 		void recalculateThumbs();
-
-		static void loadImage(const std::wstring &filename, DIP::Thumbs *thumbs, size_t index);
-		static void updateThumb(DIP::Thumbs *thumbs, size_t index);
+		void layout(int count, int &cols, int &rows, int &thumb_width, int &thumb_height) const;
+
+		Target target(unsigned int generation) const;
+		Target target(unsigned int generation, int cell_width, int cell_height) const;
+
+		std::shared_ptr<Page> createPage(int offset, int count, const Target &target) const;
+		void startPage(const std::shared_ptr<Page> &page, DIP::ThreadPool::Priority priority) const;
+		void retarget(const std::shared_ptr<Page> &page) const;
+		void prefetch();
+
+		// the window gets the placeholders of the loading cells, the canvas is drawn only when the page is complete
+		// and the cells scaled straight into it are stored in the caches
+		void drawCell(HDC hdc, const Page &page, size_t index, const Cell &cell, const Target &target, int x, int y) const;
+		void drawCell(const DIP::Image &canvas, const Page &page, size_t index, const Cell &cell, const Target &target, int x, int y) const;
+		void drawScaled(HDC hdc, const DIP::Image &image, int x, int y, const Target &target) const;
+		void drawScaled(const DIP::Image &canvas, const DIP::Image &image, int x, int y, const Target &target) const;
+		void storeScaled(const Page &page, size_t index, const Cell &cell, const Target &target, const DIP::Image &canvas, int x, int y) const;
+		void drawPlaceholder(HDC hdc, int x, int y, const DIP::ImageInfo &info) const;
+
+		static void probeImage(std::shared_ptr<Page> page, size_t index);
+		static void loadImage(std::shared_ptr<Page> page, size_t index);
+		static void updateThumb(std::shared_ptr<Page> page, size_t index, const Target &target);
+		// makes the thumbnail, stores it in the cache and fits it into the cell, nullptr means the image is drawn as is
+		static std::shared_ptr<DIP::Image> renderThumb(const Page &page, std::shared_ptr<DIP::Image> &image, const std::wstring &filename, const Target &target, const DIP::ImageInfo &info);
+		static std::shared_ptr<DIP::Image> makeThumb(const Page &page, std::shared_ptr<DIP::Image> &image, const std::wstring &filename, const Target &target);
+		static void notify(const Page &page, size_t index);
+		static std::shared_ptr<DIP::Image> loadCached(const Page &page, const std::wstring &filename, const Target &target, DIP::ImageInfo &info);
+		static void storeCached(const Page &page, const std::wstring &filename, const Target &target, const DIP::Image &thumb, const DIP::ImageInfo &info);
+		static std::wstring cacheSettings(const Target &target);
+		// the box the images are reduced to on decoding, the next quantized size above the target, so the image
+		// still covers the thumbnail when the cell grows a little and is not decoded on every resize
+		static std::pair<int, int> decodeSize(const Target &target);
+		static std::pair<int, int> thumbSize(const DIP::Image &image, const Target &target);
+		// the thumbnail rendered at the quantized size scaled to the cell, the same one if it fits
+		static std::shared_ptr<DIP::Image> fitThumb(const std::shared_ptr<DIP::Image> &thumb, const Target &target);
+		static int quantize(int size);
+		static DIP::Compositor thumbCompositor(const Target &target);
+		static void store(Page &page, size_t index, const std::shared_ptr<DIP::Image> &image, const std::shared_ptr<DIP::Image> &thumb);
+		// the memory the page takes once it is loaded, the images not loaded yet are estimated by the probed size
+		// or by the given size of an image, the thumbnails by the size of the cell
+		static size_t pageMemory(Page &page, bool keep_images, size_t image_memory);
+		// the lock of the page is held by the caller, the page over its budget keeps the thumbnails only
+		// or is cancelled if they are still too large
+		static void limit(Page &page);
+		static void cancel(Page &page);
 	};
 } // namespace DIP
 
@@ -0,0 +1,339 @@
+#include "XdgThumbCache.h"
+
+#include "Logger.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+	const int FLAVOR_SIZES[] = {128, 256, 512, 1024};
+	const wchar_t *FLAVOR_NAMES[] = {L"normal", L"large", L"x-large", L"xx-large"};
+	const int FLAVORS = 4;
+
+	// RFC 1321
+	class Md5
+	{
+	public:
+		void update(const void *data, size_t size)
+		{
+			const unsigned char *bytes = static_cast<const unsigned char *>(data);
+			for (size_t i = 0; i < size; ++i) {
+				m_block[m_length++ % 64] = bytes[i];
+				if (m_length % 64 == 0) {
+					this->transform();
+				}
+			}
+		}
+
+		std::string hex()
+		{
+			uint64_t bits = m_length * 8;
+			unsigned char padding = 0x80;
+			this->update(&padding, 1);
+			padding = 0;
+			while (m_length % 64 != 56) {
+				this->update(&padding, 1);
+			}
+			unsigned char length[8];
+			for (int i = 0; i < 8; ++i) {
+				length[i] = static_cast<unsigned char>(bits >> (i * 8));
+			}
+			this->update(length, 8);
+
+			static const char digits[] = "0123456789abcdef";
+			std::string result;
+			for (uint32_t word : m_state) {
+				for (int i = 0; i < 4; ++i) {
+					unsigned char byte = static_cast<unsigned char>(word >> (i * 8));
+					result += digits[byte >> 4];
+					result += digits[byte & 15];
+				}
+			}
+			return result;
+		}
+
+	private:
+		void transform()
+		{
+			static const uint32_t sines[64] = {
+				0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+				0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+				0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+				0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+				0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+				0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+				0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+				0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+			};
+			static const int shifts[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+			uint32_t words[16];
+			for (int i = 0; i < 16; ++i) {
+				words[i] = m_block[i * 4] | (m_block[i * 4 + 1] << 8) | (m_block[i * 4 + 2] << 16) | (static_cast<uint32_t>(m_block[i * 4 + 3]) << 24);
+			}
+
+			uint32_t a = m_state[0];
+			uint32_t b = m_state[1];
+			uint32_t c = m_state[2];
+			uint32_t d = m_state[3];
+
+			for (int i = 0; i < 64; ++i) {
+				uint32_t f;
+				int g;
+				switch (i / 16) {
+					case 0:
+						f = (b & c) | (~b & d);
+						g = i;
+						break;
+					case 1:
+						f = (d & b) | (~d & c);
+						g = (5 * i + 1) % 16;
+						break;
+					case 2:
+						f = b ^ c ^ d;
+						g = (3 * i + 5) % 16;
+						break;
+					default:
+						f = c ^ (b | ~d);
+						g = (7 * i) % 16;
+						break;
+				}
+				uint32_t sum = a + f + sines[i] + words[g];
+				int shift = shifts[(i / 16) * 4 + i % 4];
+				a = d;
+				d = c;
+				c = b;
+				b += (sum << shift) | (sum >> (32 - shift));
+			}
+
+			m_state[0] += a;
+			m_state[1] += b;
+			m_state[2] += c;
+			m_state[3] += d;
+		}
+
+		uint32_t m_state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+		unsigned char m_block[64];
+		uint64_t m_length = 0;
+	};
+
+	// the characters GLib leaves as they are in the paths of the file URIs
+	std::string escapeUri(const std::string &path)
+	{
+		static const char digits[] = "0123456789ABCDEF";
+		std::string result;
+		for (unsigned char symbol : path) {
+			if (isalnum(symbol) || (symbol && strchr("!$&'()*+,-./:=@_~", symbol))) {
+				result += static_cast<char>(symbol);
+			} else {
+				result += '%';
+				result += digits[symbol >> 4];
+				result += digits[symbol & 15];
+			}
+		}
+		return result;
+	}
+
+	// the Unix paths are in UTF-8
+	std::string environment(const wchar_t *name)
+	{
+		wchar_t value[MAX_PATH * 2];
+		DWORD length = GetEnvironmentVariableW(name, value, ARRAYSIZE(value));
+		if (length == 0 || length >= ARRAYSIZE(value)) {
+			return std::string();
+		}
+		int size = WideCharToMultiByte(CP_UTF8, 0, value, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+		std::string result(static_cast<size_t>(size), '\0');
+		WideCharToMultiByte(CP_UTF8, 0, value, static_cast<int>(length), &result[0], size, nullptr, nullptr);
+		return result;
+	}
+
+	typedef wchar_t *(CDECL *DosFileName)(const char *);
+
+} // namespace
+
+DIP::XdgThumbCache::XdgThumbCache(bool writable) : m_writable(writable)
+{
+}
+
+void DIP::XdgThumbCache::initialize()
+{
+	// exported by the kernel32 of Wine only
+	HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+	DosFileName dos_file_name = nullptr;
+	if (kernel) {
+		// through the generic function pointer, so the signatures of FARPROC and the exports are not compared
+		m_unix_file_name = reinterpret_cast<UnixFileName>(reinterpret_cast<void (*)()>(GetProcAddress(kernel, "wine_get_unix_file_name")));
+		dos_file_name = reinterpret_cast<DosFileName>(reinterpret_cast<void (*)()>(GetProcAddress(kernel, "wine_get_dos_file_name")));
+	}
+	if (m_unix_file_name == nullptr || dos_file_name == nullptr) {
+		Log.info(L"Shared thumbnails are available under Wine only");
+		return;
+	}
+
+	std::string directory = environment(L"XDG_CACHE_HOME");
+	if (directory.empty()) {
+		std::string home = environment(L"HOME");
+		if (home.empty()) {
+			return;
+		}
+		directory = home + "/.cache";
+	}
+	directory += "/thumbnails";
+
+	// the Wine functions return the buffers allocated on the process heap
+	wchar_t *path = dos_file_name(directory.data());
+	if (path) {
+		m_directory = path;
+		HeapFree(GetProcessHeap(), 0, path);
+	}
+
+	Log.debug(L"Shared thumbnails directory | directory = %s", m_directory.data());
+}
+
+bool DIP::XdgThumbCache::isValid()
+{
+	std::call_once(m_initialized, [this] {
+		this->initialize();
+	});
+	return m_directory.empty() == false;
+}
+
+bool DIP::XdgThumbCache::isWritable() const
+{
+	return m_writable;
+}
+
+int DIP::XdgThumbCache::flavor(int width, int height)
+{
+	for (int i = 0; i < FLAVORS; ++i) {
+		if (width <= FLAVOR_SIZES[i] && height <= FLAVOR_SIZES[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool DIP::XdgThumbCache::locate(const std::wstring &filename, Location &location) const
+{
+	char *path = m_unix_file_name(filename.data());
+	if (path == nullptr) {
+		return false;
+	}
+	location.uri = "file://" + escapeUri(path);
+	HeapFree(GetProcessHeap(), 0, path);
+
+	Md5 md5;
+	md5.update(location.uri.data(), location.uri.size());
+	std::string name = md5.hex() + ".png";
+	location.name.assign(name.begin(), name.end());
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesExW(filename.data(), GetFileExInfoStandard, &data) == 0) {
+		return false;
+	}
+	// the Unix time in seconds
+	unsigned long long time = (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+	location.mtime = static_cast<long long>(time / 10000000) - 11644473600LL;
+	location.size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	return true;
+}
+
+DIP::Image *DIP::XdgThumbCache::load(const std::wstring &filename, int width, int height, DIP::ImageInfo &info)
+{
+	int first = flavor(width, height);
+	Location location;
+	if (first < 0 || this->isValid() == false || this->locate(filename, location) == false) {
+		return nullptr;
+	}
+
+	for (int i = first; i < FLAVORS; ++i) {
+		std::wstring thumbname = m_directory + L"\\" + FLAVOR_NAMES[i] + L"\\" + location.name;
+		if (GetFileAttributesW(thumbname.data()) == INVALID_FILE_ATTRIBUTES) {
+			continue;
+		}
+
+		std::unique_ptr<DIP::Image> thumb(new DIP::Image(thumbname.data()));
+		if (thumb->isInitialized() == false) {
+			continue;
+		}
+		// the thumbnail of the other version of the file
+		if (thumb->text("Thumb::URI") != location.uri || atoll(thumb->text("Thumb::MTime").data()) != location.mtime) {
+			continue;
+		}
+		std::string size = thumb->text("Thumb::Size");
+		if (size.empty() == false && strtoull(size.data(), nullptr, 10) != location.size) {
+			continue;
+		}
+
+		// the original size tells if the thumbnail covers the cells
+		if (DIP::Image::probe(filename.data(), info) == false) {
+			info.width = atoi(thumb->text("Thumb::Image::Width").data());
+			info.height = atoi(thumb->text("Thumb::Image::Height").data());
+			info.bpp = thumb->bpp();
+			info.alpha = thumb->hasAlpha();
+			if (info.width <= 0 || info.height <= 0) {
+				continue;
+			}
+		}
+		thumb->setSourceSize(info.width, info.height);
+		return thumb.release();
+	}
+
+	return nullptr;
+}
+
+void DIP::XdgThumbCache::store(const std::wstring &filename, const DIP::Image &image, int width, int height)
+{
+	int index = flavor(width, height);
+	Location location;
+	if (m_writable == false || index < 0 || this->isValid() == false || this->locate(filename, location) == false) {
+		return;
+	}
+	// the thumbnails themselves get no thumbnails
+	if (_wcsnicmp(filename.data(), m_directory.data(), m_directory.size()) == 0) {
+		return;
+	}
+
+	// the thumbnails are not larger than the originals
+	DIP::ImageInfo info = image.info();
+	int limit = FLAVOR_SIZES[index];
+	std::pair<int, int> size(info.width, info.height);
+	if (size.first > limit || size.second > limit) {
+		size = DIP::Image::inscribe(info.width, info.height, limit, limit);
+	}
+	// the image decoded at a reduced size may be too small for the flavor
+	if (image.orientedWidth() < size.first || image.orientedHeight() < size.second) {
+		return;
+	}
+
+	std::unique_ptr<DIP::Image> thumb(image.scaled(size.first, size.second, DIP_IMAGE_FILTER_BICUBIC | DIP_IMAGE_FILTER_AUTO));
+	if (thumb == nullptr || thumb->isInitialized() == false) {
+		return;
+	}
+	thumb->setText("Thumb::URI", location.uri);
+	thumb->setText("Thumb::MTime", std::to_string(location.mtime));
+	thumb->setText("Thumb::Size", std::to_string(location.size));
+	thumb->setText("Thumb::Image::Width", std::to_string(info.width));
+	thumb->setText("Thumb::Image::Height", std::to_string(info.height));
+	thumb->setText("Software", "DirImage");
+
+	std::wstring directory = m_directory + L"\\" + FLAVOR_NAMES[index];
+	CreateDirectoryW(m_directory.data(), nullptr);
+	CreateDirectoryW(directory.data(), nullptr);
+
+	// written aside and renamed, as the specification requires
+	std::wstring thumbname = directory + L"\\" + location.name;
+	std::wstring temporary = thumbname.substr(0, thumbname.size() - 4) + L"." + std::to_wstring(GetCurrentThreadId()) + L".png";
+	if (thumb->save(temporary.data()) == false || MoveFileExW(temporary.data(), thumbname.data(), MOVEFILE_REPLACE_EXISTING) == 0) {
+		Log.error(L"Shared thumbnail cannot be stored | filename = %s", thumbname.data());
+		DeleteFileW(temporary.data());
+		return;
+	}
+
+	Log.debug(L"Shared thumbnail has been stored | filename = %s", thumbname.data());
+}
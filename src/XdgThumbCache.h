@@ -0,0 +1,59 @@
+#ifndef DIP_XDGTHUMBCACHE_H
+#define DIP_XDGTHUMBCACHE_H
+
+#include "Image.h"
+
+#include <string>
+#include <mutex>
+
+namespace DIP {
+
+	// the thumbnails shared with the file managers by the freedesktop.org thumbnail specification
+	// (~/.cache/thumbnails/{normal,large,x-large,xx-large}/<md5 of the file URI>.png), available under Wine only,
+	// since the URIs are made of the Unix paths
+	class XdgThumbCache
+	{
+	public:
+		XdgThumbCache(bool writable);
+
+		XdgThumbCache(const XdgThumbCache&) = delete;
+		XdgThumbCache& operator=(const XdgThumbCache&) = delete;
+
+		// the Wine functions and the cache directory are looked up on the first use
+		bool isValid();
+		bool isWritable() const;
+
+		// the thumbnail of the smallest size that covers the box, nullptr if there is none for the current version
+		// of the file, the info describes the original image
+		DIP::Image *load(const std::wstring &filename, int width, int height, DIP::ImageInfo &info);
+		// stores the thumbnail of the size chosen by the box, if the decoded image is large enough for it
+		void store(const std::wstring &filename, const DIP::Image &image, int width, int height);
+
+	private:
+		struct Location {
+			std::string uri;
+			std::wstring name;
+			long long mtime = 0;
+			unsigned long long size = 0;
+		};
+
+		// the index of the smallest flavor covering the box, -1 if the box is too large for all of them
+		static int flavor(int width, int height);
+		// the URI of the file, the name of its thumbnails and the stamp of its version
+		bool locate(const std::wstring &filename, Location &location) const;
+
+		void initialize();
+
+		bool m_writable;
+
+		std::once_flag m_initialized;
+		// the DOS path of the thumbnails directory, empty if the cache is not available
+		std::wstring m_directory;
+
+		typedef char *(CDECL *UnixFileName)(const wchar_t *);
+		UnixFileName m_unix_file_name = nullptr;
+	};
+
+} // namespace DIP
+
+#endif // DIP_XDGTHUMBCACHE_H
@@ -31,6 +31,7 @@ extern "C" {
 			}
 
 			case DLL_PROCESS_DETACH:
+				// the thread pool is not destroyed here on purpose: its workers cannot be joined under the loader lock
 				DIP::Master::deinitialize();
 				DIP::Logger::deinitialize();
 				break;
@@ -0,0 +1,28 @@
+INCLUDEPATH += ../../src ../../vendors
+
+contains(QMAKE_TARGET.arch, x86_64) {
+	LIBS += -lFreeImage -L$$_PRO_FILE_PWD_/../../vendors/FreeImage/x64
+} else {
+	LIBS += -lFreeImage -L$$_PRO_FILE_PWD_/../../vendors/FreeImage/x32
+}
+
+msvc: LIBS += -luser32 -lgdi32
+
+TARGET = ImageCheck
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+SOURCES += \
+	main.cpp \
+	../../src/Image.cpp \
+	../../src/Compositor.cpp \
+	../../src/MappedFile.cpp \
+	../../src/Resampler.cpp \
+	../../src/ThreadPool.cpp \
+	../../src/Logger.cpp
+
+HEADERS += \
+	../../src/Image.h \
+	../../src/Compositor.h
@@ -0,0 +1,113 @@
+// checks the compositing of the transparent images: the copies blended over a color or the checkerboard have to
+// come out opaque with the background in place of the transparent pixels, the opaque images stay as they are
+
+#include "Image.h"
+#include "Compositor.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+
+	const int SIZE = 16;
+
+	int failures = 0;
+
+	void check(bool condition, const char *what)
+	{
+		if (condition == false) {
+			printf("FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	// the BGRA pixels of the same color and alpha
+	DIP::Image *makeImage(unsigned char blue, unsigned char green, unsigned char red, unsigned char alpha)
+	{
+		std::vector<unsigned char> pixels(SIZE * SIZE * 4);
+		for (size_t i = 0; i < pixels.size(); i += 4) {
+			pixels[i] = blue;
+			pixels[i + 1] = green;
+			pixels[i + 2] = red;
+			pixels[i + 3] = alpha;
+		}
+		return new DIP::Image(SIZE, SIZE, 4, pixels.data());
+	}
+
+	// every pixel is within the tolerance of the expected one, the alpha is not compared
+	bool hasColor(const DIP::Image &image, int blue, int green, int red, int tolerance)
+	{
+		int channels = image.channels();
+		if (channels < 3) {
+			return false;
+		}
+		for (int line = 0; line < image.height(); ++line) {
+			const unsigned char *row = image.row(line);
+			for (int x = 0; x < image.width(); ++x) {
+				const unsigned char *pixel = row + x * channels;
+				if (abs(pixel[0] - blue) > tolerance || abs(pixel[1] - green) > tolerance || abs(pixel[2] - red) > tolerance) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool hasCheckerboard(const DIP::Image &image)
+	{
+		int channels = image.channels();
+		bool light = false;
+		bool dark = false;
+		for (int line = 0; channels >= 3 && line < image.height(); ++line) {
+			const unsigned char *row = image.row(line);
+			for (int x = 0; x < image.width(); ++x) {
+				const unsigned char *pixel = row + x * channels;
+				if (pixel[0] != pixel[1] || pixel[1] != pixel[2]) {
+					return false;
+				}
+				light = light || pixel[0] == DIP_COMPOSITOR_CHECKERBOARD_LIGHT;
+				dark = dark || pixel[0] == DIP_COMPOSITOR_CHECKERBOARD_DARK;
+			}
+		}
+		return light && dark;
+	}
+
+} // namespace
+
+int main()
+{
+	DIP::Compositor color(DIP::Compositor::MODE_COLOR, 10, 20, 30);
+	DIP::Compositor checkerboard(DIP::Compositor::MODE_CHECKERBOARD);
+
+	std::unique_ptr<DIP::Image> transparent(makeImage(200, 100, 50, 0));
+	check(transparent->isInitialized() && transparent->isOpaque() == false, "the transparent source is not opaque");
+
+	std::unique_ptr<DIP::Image> over_color(transparent->composited(color));
+	check(over_color && over_color->isOpaque(), "the copy blended over a color is opaque");
+	check(over_color && hasColor(*over_color, 30, 20, 10, 0), "the transparent pixels become the background color");
+
+	std::unique_ptr<DIP::Image> over_checkerboard(transparent->composited(checkerboard));
+	check(over_checkerboard && over_checkerboard->isOpaque(), "the copy blended over the checkerboard is opaque");
+	check(over_checkerboard && hasCheckerboard(*over_checkerboard), "the transparent pixels become the checkerboard");
+
+	check(transparent->isOpaque() == false && hasColor(*transparent, 200, 100, 50, 0), "the source is left as it was");
+
+	// 128 of 255 of the pixel over the background
+	std::unique_ptr<DIP::Image> translucent(makeImage(200, 100, 50, 128));
+	std::unique_ptr<DIP::Image> blended(translucent->composited(color));
+	check(blended && hasColor(*blended, (200 * 128 + 30 * 127) / 255, (100 * 128 + 20 * 127) / 255, (50 * 128 + 10 * 127) / 255, 1), "the translucent pixels are blended");
+
+	std::unique_ptr<DIP::Image> opaque(makeImage(200, 100, 50, 255));
+	std::unique_ptr<DIP::Image> copied(opaque->composited(color));
+	check(opaque->isOpaque(), "the source with the full alpha is opaque");
+	check(transparent->hasAlpha() && transparent->info().alpha && opaque->hasAlpha() == false && opaque->info().alpha == false, "the alpha of the info follows the opacity");
+	check(copied && hasColor(*copied, 200, 100, 50, 0), "the opaque pixels are kept");
+
+	// the in-place blending of the kept images
+	check(transparent->composite(color) && transparent->isOpaque() && hasColor(*transparent, 30, 20, 10, 0), "the transparent image is blended in place");
+
+	printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
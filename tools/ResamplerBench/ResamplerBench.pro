@@ -0,0 +1,29 @@
+INCLUDEPATH += ../../src ../../vendors
+
+# the double-precision reference is used instead of FreeImage_Rescale
+no_freeimage {
+	DEFINES += DIP_BENCH_NO_FREEIMAGE
+} else {
+	contains(QMAKE_TARGET.arch, x86_64) {
+		LIBS += -lFreeImage -L$$_PRO_FILE_PWD_/../../vendors/FreeImage/x64
+	} else {
+		LIBS += -lFreeImage -L$$_PRO_FILE_PWD_/../../vendors/FreeImage/x32
+	}
+}
+
+TARGET = ResamplerBench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+CONFIG(release, debug|release) {
+	gcc: QMAKE_CXXFLAGS_RELEASE += -O2
+}
+
+SOURCES += \
+	main.cpp \
+	../../src/Resampler.cpp
+
+HEADERS += \
+	../../src/Resampler.h
@@ -0,0 +1,340 @@
+// compares DIP::Resampler with FreeImage_Rescale (the speed and the difference of the pixels) for every filter
+// and a row of the scale ratios, the double-precision separable filter is the reference when FreeImage is not linked
+
+#include "Resampler.h"
+#include "Image.h"
+
+#ifndef DIP_BENCH_NO_FREEIMAGE
+#if defined(_WIN64)
+#include "FreeImage/x64/FreeImage.h"
+#else
+#include "FreeImage/x32/FreeImage.h"
+#endif
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace {
+
+	struct Filter {
+		int id;
+		const char *name;
+		double width;
+	};
+
+	const Filter filters[] = {
+		{DIP_IMAGE_FILTER_BOX,        "box",        0.5},
+		{DIP_IMAGE_FILTER_BILINEAR,   "bilinear",   1},
+		{DIP_IMAGE_FILTER_BICUBIC,    "bicubic",    2},
+		{DIP_IMAGE_FILTER_BSPLINE,    "bspline",    2},
+		{DIP_IMAGE_FILTER_CATMULLROM, "catmullrom", 2},
+		{DIP_IMAGE_FILTER_LANCZOS3,   "lanczos3",   3}
+	};
+
+	struct Case {
+		int source_width;
+		int source_height;
+		int width;
+		int height;
+	};
+
+	// the reductions of a photo to the page, the cell and the small thumbnail sizes, and an enlargement
+	const Case cases[] = {
+		{4000, 3000, 2000, 1500},
+		{4000, 3000, 1000, 750},
+		{4000, 3000, 400, 300},
+		{4000, 3000, 160, 120},
+		{800, 600, 1200, 900}
+	};
+
+	struct Bitmap {
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		std::vector<unsigned char> pixels;
+
+		Bitmap(int width, int height, int channels) : width(width), height(height), channels(channels), pixels(static_cast<size_t>(width) * height * channels)
+		{
+		}
+
+		size_t pitch() const
+		{
+			return static_cast<size_t>(width) * channels;
+		}
+
+		unsigned char *row(int y)
+		{
+			return &pixels[y * this->pitch()];
+		}
+	};
+
+	// the smooth gradients with the edges and the noise, so every filter has something to do
+	Bitmap makeSource(int width, int height, int channels)
+	{
+		Bitmap bitmap(width, height, channels);
+		unsigned int seed = 12345;
+		for (int y = 0; y < height; ++y) {
+			unsigned char *row = bitmap.row(y);
+			for (int x = 0; x < width; ++x) {
+				seed = seed * 1103515245 + 12345;
+				int noise = static_cast<int>((seed >> 16) & 15) - 8;
+				bool edge = ((x / 97) + (y / 61)) % 2 == 0;
+				for (int c = 0; c < channels; ++c) {
+					int value = c == 3 ? 255 - (x * 255 / width) / 2 : (x * (c + 1) * 255 / width + y * 255 / height) / (c + 2);
+					value += (edge ? 40 : 0) + noise;
+					row[x * channels + c] = static_cast<unsigned char>(value < 0 ? 0 : (value > 255 ? 255 : value));
+				}
+			}
+		}
+		return bitmap;
+	}
+
+#ifdef DIP_BENCH_NO_FREEIMAGE
+	const double pi = 3.14159265358979323846;
+
+	double sinc(double x)
+	{
+		x *= pi;
+		return x != 0 ? sin(x) / x : 1;
+	}
+
+	// the filters of FreeImage (Filters.h)
+	double filterValue(int filter, double x)
+	{
+		double t = fabs(x);
+		switch (filter) {
+			case DIP_IMAGE_FILTER_BILINEAR:
+				return t < 1 ? 1 - t : 0;
+			case DIP_IMAGE_FILTER_BICUBIC: {
+				const double b = 1.0 / 3;
+				const double c = 1.0 / 3;
+				if (t < 1) {
+					return ((6 - 2 * b) + t * t * ((-18 + 12 * b + 6 * c) + t * (12 - 9 * b - 6 * c))) / 6;
+				}
+				return t < 2 ? ((8 * b + 24 * c) + t * ((-12 * b - 48 * c) + t * ((6 * b + 30 * c) + t * (-b - 6 * c)))) / 6 : 0;
+			}
+			case DIP_IMAGE_FILTER_BSPLINE:
+				if (t < 1) {
+					return 2.0 / 3 + (0.5 * t * t * t - t * t);
+				}
+				return t < 2 ? (2 - t) * (2 - t) * (2 - t) / 6 : 0;
+			case DIP_IMAGE_FILTER_CATMULLROM:
+				if (t < 1) {
+					return 0.5 * (2 + t * t * (-5 + 3 * t));
+				}
+				return t < 2 ? 0.5 * (4 + t * (-8 + t * (5 - t))) : 0;
+			case DIP_IMAGE_FILTER_LANCZOS3:
+				return t < 3 ? sinc(x) * sinc(x / 3) : 0;
+			default:
+				return t <= 0.5 ? 1 : 0;
+		}
+	}
+
+	// the weights of one axis in double precision, like the weights table of the FreeImage resize engine
+	struct Contributions {
+		std::vector<int> lefts;
+		std::vector<std::vector<double>> weights;
+
+		Contributions(int source_size, int size, const Filter &filter)
+		{
+			double scale = static_cast<double>(size) / source_size;
+			double width = scale < 1 ? filter.width / scale : filter.width;
+			double filter_scale = scale < 1 ? scale : 1;
+
+			for (int u = 0; u < size; ++u) {
+				double center = (u + 0.5) / scale;
+				int left = static_cast<int>(center - width + 0.5);
+				left = left < 0 ? 0 : left;
+				int right = static_cast<int>(center + width + 0.5);
+				right = right > source_size ? source_size : right;
+
+				std::vector<double> values;
+				double total = 0;
+				for (int i = left; i < right; ++i) {
+					double value = filter_scale * filterValue(filter.id, filter_scale * (i + 0.5 - center));
+					values.push_back(value);
+					total += value;
+				}
+				for (double &value : values) {
+					value = total != 0 ? value / total : 0;
+				}
+				lefts.push_back(left);
+				weights.push_back(values);
+			}
+		}
+	};
+
+	unsigned char round8(double value)
+	{
+		int result = static_cast<int>(floor(value + 0.5));
+		return static_cast<unsigned char>(result < 0 ? 0 : (result > 255 ? 255 : result));
+	}
+
+	// the horizontal pass first, the intermediate rows are kept in double precision
+	void referenceRescale(const Bitmap &source, Bitmap &destination, const Filter &filter)
+	{
+		int channels = source.channels;
+		Contributions horizontal(source.width, destination.width, filter);
+		Contributions vertical(source.height, destination.height, filter);
+
+		std::vector<double> rows(static_cast<size_t>(destination.width) * channels * source.height);
+		for (int y = 0; y < source.height; ++y) {
+			const unsigned char *row = &source.pixels[y * source.pitch()];
+			double *result = &rows[static_cast<size_t>(y) * destination.width * channels];
+			for (int x = 0; x < destination.width; ++x) {
+				const std::vector<double> &weights = horizontal.weights[x];
+				for (int c = 0; c < channels; ++c) {
+					double sum = 0;
+					for (size_t i = 0; i < weights.size(); ++i) {
+						sum += weights[i] * row[(horizontal.lefts[x] + i) * channels + c];
+					}
+					result[x * channels + c] = sum;
+				}
+			}
+		}
+
+		size_t bytes = destination.pitch();
+		for (int y = 0; y < destination.height; ++y) {
+			const std::vector<double> &weights = vertical.weights[y];
+			unsigned char *result = destination.row(y);
+			for (size_t x = 0; x < bytes; ++x) {
+				double sum = 0;
+				for (size_t i = 0; i < weights.size(); ++i) {
+					sum += weights[i] * rows[(vertical.lefts[y] + i) * bytes + x];
+				}
+				result[x] = round8(sum);
+			}
+		}
+	}
+
+#else
+	FREE_IMAGE_FILTER freeImageFilter(int filter)
+	{
+		switch (filter) {
+			case DIP_IMAGE_FILTER_BICUBIC:
+				return FILTER_BICUBIC;
+			case DIP_IMAGE_FILTER_BILINEAR:
+				return FILTER_BILINEAR;
+			case DIP_IMAGE_FILTER_BSPLINE:
+				return FILTER_BSPLINE;
+			case DIP_IMAGE_FILTER_CATMULLROM:
+				return FILTER_CATMULLROM;
+			case DIP_IMAGE_FILTER_LANCZOS3:
+				return FILTER_LANCZOS3;
+			default:
+				return FILTER_BOX;
+		}
+	}
+
+	// the scanlines of FreeImage go bottom-up, the rows of the bitmap are compared in the same order
+	FIBITMAP *toFreeImage(const Bitmap &bitmap)
+	{
+		FIBITMAP *dib = FreeImage_Allocate(bitmap.width, bitmap.height, bitmap.channels * 8);
+		for (int y = 0; y < bitmap.height; ++y) {
+			memcpy(FreeImage_GetScanLine(dib, y), &bitmap.pixels[y * bitmap.pitch()], bitmap.pitch());
+		}
+		return dib;
+	}
+
+	void fromFreeImage(FIBITMAP *dib, Bitmap &bitmap)
+	{
+		for (int y = 0; y < bitmap.height; ++y) {
+			memcpy(bitmap.row(y), FreeImage_GetScanLine(dib, y), bitmap.pitch());
+		}
+	}
+#endif
+
+	// the best of the runs, in milliseconds
+	double measure(const std::function<void()> &run)
+	{
+		double best = 1e30;
+		for (int i = 0; i < 5; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = elapsed < best ? elapsed : best;
+		}
+		return best;
+	}
+
+	struct Difference {
+		int maximum = 0;
+		double mean = 0;
+	};
+
+	Difference compare(const Bitmap &a, const Bitmap &b)
+	{
+		Difference difference;
+		long long total = 0;
+		for (size_t i = 0; i < a.pixels.size(); ++i) {
+			int delta = abs(static_cast<int>(a.pixels[i]) - static_cast<int>(b.pixels[i]));
+			difference.maximum = delta > difference.maximum ? delta : difference.maximum;
+			total += delta;
+		}
+		difference.mean = a.pixels.empty() ? 0 : static_cast<double>(total) / a.pixels.size();
+		return difference;
+	}
+
+} // namespace
+
+int main()
+{
+#ifndef DIP_BENCH_NO_FREEIMAGE
+	FreeImage_Initialise();
+	const char *other = "FreeImage";
+#else
+	const char *other = "reference";
+#endif
+
+	printf("Resampler kernels: %s, compared with: %s, single thread, the best of 5 runs\n\n", DIP::Resampler::instructionSet(), other);
+	printf("%-10s %-22s %2s %10s %10s %8s %5s %6s\n", "filter", "size", "ch", "dip, ms", "other, ms", "speedup", "max", "mean");
+
+	for (int channels = 3; channels <= 4; ++channels) {
+		for (const Case &test : cases) {
+			Bitmap source = makeSource(test.source_width, test.source_height, channels);
+
+			for (const Filter &filter : filters) {
+				Bitmap result(test.width, test.height, channels);
+				Bitmap expected(test.width, test.height, channels);
+
+				double dip = measure([&] {
+					DIP::Resampler resampler(test.source_width, test.source_height, test.width, test.height, channels, filter.id);
+					resampler.resample(source.pixels.data(), source.pitch(), result.pixels.data(), result.pitch());
+				});
+
+#ifndef DIP_BENCH_NO_FREEIMAGE
+				FIBITMAP *dib = toFreeImage(source);
+				FIBITMAP *scaled = nullptr;
+				double reference = measure([&] {
+					FreeImage_Unload(scaled);
+					scaled = FreeImage_Rescale(dib, test.width, test.height, freeImageFilter(filter.id));
+				});
+				fromFreeImage(scaled, expected);
+				FreeImage_Unload(scaled);
+				FreeImage_Unload(dib);
+#else
+				double reference = measure([&] {
+					referenceRescale(source, expected, filter);
+				});
+#endif
+
+				Difference difference = compare(result, expected);
+
+				char size[32];
+				snprintf(size, sizeof(size), "%dx%d -> %dx%d", test.source_width, test.source_height, test.width, test.height);
+				printf("%-10s %-22s %2d %10.2f %10.2f %7.1fx %5d %6.3f\n", filter.name, size, channels, dip, reference, reference / dip, difference.maximum, difference.mean);
+			}
+		}
+	}
+
+#ifndef DIP_BENCH_NO_FREEIMAGE
+	FreeImage_DeInitialise();
+#endif
+	return 0;
+}